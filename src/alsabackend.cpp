@@ -0,0 +1,324 @@
+#include "alsabackend.hpp"
+#include "realtime.hpp"
+#include <alsa/asoundlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+namespace deepness
+{
+    namespace
+    {
+        void check(int err, const char *what)
+        {
+            if(err < 0)
+                throw AudioBackend::Exception(std::string("Error ") + what + ": " + snd_strerror(err));
+        }
+
+        float toFloat(const char *sample, int format)
+        {
+            switch(format)
+            {
+            case SND_PCM_FORMAT_FLOAT_LE:
+                return *reinterpret_cast<const float *>(sample);
+            case SND_PCM_FORMAT_S32_LE:
+                return *reinterpret_cast<const std::int32_t *>(sample) * (1.f / 2147483648.f);
+            default:
+                return *reinterpret_cast<const std::int16_t *>(sample) * (1.f / 32768.f);
+            }
+        }
+
+        void fromFloat(float value, char *sample, int format)
+        {
+            value = std::min(1.f, std::max(-1.f, value));
+            switch(format)
+            {
+            case SND_PCM_FORMAT_FLOAT_LE:
+                *reinterpret_cast<float *>(sample) = value;
+                break;
+            case SND_PCM_FORMAT_S32_LE:
+                *reinterpret_cast<std::int32_t *>(sample) = static_cast<std::int32_t>(value * 2147483647.f);
+                break;
+            default:
+                *reinterpret_cast<std::int16_t *>(sample) = static_cast<std::int16_t>(value * 32767.f);
+                break;
+            }
+        }
+
+        char *areaAddress(const snd_pcm_channel_area_t &area, snd_pcm_uframes_t offset)
+        {
+            return static_cast<char *>(area.addr) + (area.first + offset * area.step) / 8;
+        }
+    }
+
+    AlsaBackend::AlsaBackend(double sampleRate, Settings settings)
+        : m_settings(std::move(settings))
+        , m_sampleRate(sampleRate)
+        , m_capture(nullptr)
+        , m_playback(nullptr)
+        , m_linked(false)
+        , m_input(m_settings.bufferSamples, 0.f)
+        , m_output(m_settings.bufferSamples, 0.f)
+        , m_running(false)
+        , m_xruns(0)
+    {
+        try
+        {
+            m_capture = open(SND_PCM_STREAM_CAPTURE, m_captureFormat);
+            m_playback = open(SND_PCM_STREAM_PLAYBACK, m_playbackFormat);
+        }
+        catch(...)
+        {
+            if(m_capture)
+                snd_pcm_close(m_capture);
+            throw;
+        }
+        m_linked = snd_pcm_link(m_capture, m_playback) == 0;
+        if(!m_linked)
+            std::cerr << "Could not link capture and playback, starting them separately" << std::endl;
+        std::cerr << "Using ALSA device " << m_settings.device << " with " << m_settings.bufferSamples
+                  << " frames per period" << std::endl;
+    }
+
+    AlsaBackend::~AlsaBackend()
+    {
+        stop();
+        if(m_linked)
+            snd_pcm_unlink(m_capture);
+        snd_pcm_close(m_playback);
+        snd_pcm_close(m_capture);
+    }
+
+    snd_pcm_t *AlsaBackend::open(int stream, Format &format)
+    {
+        snd_pcm_t *pcm = nullptr;
+        check(snd_pcm_open(&pcm, m_settings.device.c_str(), static_cast<snd_pcm_stream_t>(stream), 0), "opening ALSA device");
+        try
+        {
+            snd_pcm_hw_params_t *hw;
+            snd_pcm_hw_params_alloca(&hw);
+            check(snd_pcm_hw_params_any(pcm, hw), "querying hardware parameters");
+            check(snd_pcm_hw_params_set_rate_resample(pcm, hw, 0), "disabling resampling");
+            check(snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED), "setting mmap access");
+            format.format = SND_PCM_FORMAT_UNKNOWN;
+            for(auto candidate: {SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE})
+            {
+                if(snd_pcm_hw_params_test_format(pcm, hw, candidate) == 0)
+                {
+                    format.format = candidate;
+                    break;
+                }
+            }
+            if(format.format == SND_PCM_FORMAT_UNKNOWN)
+                throw Exception("No supported sample format on " + m_settings.device);
+            check(snd_pcm_hw_params_set_format(pcm, hw, static_cast<snd_pcm_format_t>(format.format)), "setting sample format");
+            // hw devices often can't do mono, so take the smallest channel count and use the first channel
+            check(snd_pcm_hw_params_get_channels_min(hw, &format.channels), "querying channels");
+            format.channels = std::max(1u, format.channels);
+            check(snd_pcm_hw_params_set_channels(pcm, hw, format.channels), "setting channels");
+            auto rate = static_cast<unsigned int>(m_sampleRate);
+            check(snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, nullptr), "setting sample rate");
+            if(rate != static_cast<unsigned int>(m_sampleRate))
+                throw Exception("Sample rate " + std::to_string(m_sampleRate) + " not supported by " + m_settings.device);
+            check(snd_pcm_hw_params_set_period_size(pcm, hw, m_settings.bufferSamples, 0), "setting period size");
+            check(snd_pcm_hw_params_set_periods(pcm, hw, m_settings.periods, 0), "setting periods");
+            check(snd_pcm_hw_params(pcm, hw), "applying hardware parameters");
+
+            snd_pcm_sw_params_t *sw;
+            snd_pcm_sw_params_alloca(&sw);
+            check(snd_pcm_sw_params_current(pcm, sw), "querying software parameters");
+            check(snd_pcm_sw_params_set_avail_min(pcm, sw, m_settings.bufferSamples), "setting avail min");
+            // never start by ourselves, run() starts both streams together
+            snd_pcm_uframes_t boundary;
+            check(snd_pcm_sw_params_get_boundary(sw, &boundary), "querying boundary");
+            check(snd_pcm_sw_params_set_start_threshold(pcm, sw, boundary), "setting start threshold");
+            check(snd_pcm_sw_params(pcm, sw), "applying software parameters");
+        }
+        catch(...)
+        {
+            snd_pcm_close(pcm);
+            throw;
+        }
+        return pcm;
+    }
+
+    void AlsaBackend::start(CallbackFunc callback)
+    {
+        if(m_thread.joinable())
+            throw Exception("ALSA backend already started");
+        m_callback = std::move(callback);
+        m_running = true;
+        // the audio thread locks the memory, its own stack included, and only then starts
+        // the streams, so the page faults of locking can't cause the first xrun
+        std::promise<void> started;
+        auto result = started.get_future();
+        m_thread = std::thread([this, &started] {
+                run(started);
+            });
+        try
+        {
+            result.get();
+        }
+        catch(...)
+        {
+            m_thread.join();
+            throw;
+        }
+    }
+
+    void AlsaBackend::stop()
+    {
+        m_running = false;
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+            snd_pcm_drop(m_capture);
+            if(!m_linked)
+                snd_pcm_drop(m_playback);
+            if(m_xruns)
+                std::cerr << "ALSA xruns: " << m_xruns << std::endl;
+        }
+    }
+
+    double AlsaBackend::getSampleRate() const
+    {
+        return m_sampleRate;
+    }
+
+    void AlsaBackend::prepare()
+    {
+        check(snd_pcm_prepare(m_capture), "preparing capture");
+        if(!m_linked)
+            check(snd_pcm_prepare(m_playback), "preparing playback");
+        // fill the playback ring with silence so the first periods have something to play
+        std::fill(m_output.begin(), m_output.end(), 0.f);
+        for(auto i = 0u; i < m_settings.periods; ++i)
+            writePlayback(m_output.data(), m_settings.bufferSamples);
+        check(snd_pcm_start(m_capture), "starting capture");
+        if(!m_linked)
+            check(snd_pcm_start(m_playback), "starting playback");
+    }
+
+    void AlsaBackend::recover()
+    {
+        ++m_xruns;
+        snd_pcm_drop(m_capture);
+        if(!m_linked)
+            snd_pcm_drop(m_playback);
+        try
+        {
+            prepare();
+        }
+        catch(Exception const& e)
+        {
+            std::cerr << e.what() << std::endl;
+            m_running = false;
+        }
+    }
+
+    void AlsaBackend::run(std::promise<void> &started)
+    {
+        auto err = setRealtimePriority(m_settings.priority);
+        if(!err.empty())
+            std::cerr << err << std::endl;
+        if(m_settings.lockMemory)
+        {
+            err = lockMemory();
+            if(!err.empty())
+                std::cerr << err << std::endl;
+        }
+        if(m_settings.cpu >= 0)
+        {
+            err = setCpuAffinity(m_settings.cpu);
+            if(!err.empty())
+                std::cerr << err << std::endl;
+        }
+        try
+        {
+            prepare();
+        }
+        catch(...)
+        {
+            m_running = false;
+            started.set_exception(std::current_exception());
+            return;
+        }
+        started.set_value();
+        auto period = static_cast<snd_pcm_sframes_t>(m_settings.bufferSamples);
+        while(m_running)
+        {
+            auto ready = snd_pcm_wait(m_capture, 1000);
+            if(ready < 0)
+            {
+                recover();
+                continue;
+            }
+            auto captureAvail = snd_pcm_avail_update(m_capture);
+            auto playbackAvail = snd_pcm_avail_update(m_playback);
+            if(captureAvail < 0 || playbackAvail < 0)
+            {
+                recover();
+                continue;
+            }
+            try
+            {
+                while(captureAvail >= period && playbackAvail >= period)
+                {
+                    readCapture(m_input.data(), m_settings.bufferSamples);
+                    m_callback(m_input.data(), m_output.data(), m_settings.bufferSamples);
+                    writePlayback(m_output.data(), m_settings.bufferSamples);
+                    captureAvail -= period;
+                    playbackAvail -= period;
+                }
+            }
+            catch(Exception const&)
+            {
+                // mmap_begin and commit fail on xruns
+                recover();
+            }
+        }
+    }
+
+    void AlsaBackend::readCapture(float *buffer, unsigned long frames)
+    {
+        while(frames)
+        {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t count = frames;
+            check(snd_pcm_mmap_begin(m_capture, &areas, &offset, &count), "mapping capture buffer");
+            auto *sample = areaAddress(areas[0], offset);
+            auto step = areas[0].step / 8;
+            for(decltype(count) i = 0; i < count; ++i, sample += step)
+                buffer[i] = toFloat(sample, m_captureFormat.format);
+            auto committed = snd_pcm_mmap_commit(m_capture, offset, count);
+            if(committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != count)
+                throw Exception("Error committing capture buffer");
+            buffer += count;
+            frames -= count;
+        }
+    }
+
+    void AlsaBackend::writePlayback(const float *buffer, unsigned long frames)
+    {
+        while(frames)
+        {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t count = frames;
+            check(snd_pcm_mmap_begin(m_playback, &areas, &offset, &count), "mapping playback buffer");
+            for(auto channel = 0u; channel < m_playbackFormat.channels; ++channel)
+            {
+                auto *sample = areaAddress(areas[channel], offset);
+                auto step = areas[channel].step / 8;
+                for(decltype(count) i = 0; i < count; ++i, sample += step)
+                    fromFloat(buffer[i], sample, m_playbackFormat.format);
+            }
+            auto committed = snd_pcm_mmap_commit(m_playback, offset, count);
+            if(committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != count)
+                throw Exception("Error committing playback buffer");
+            buffer += count;
+            frames -= count;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "audiobackend.hpp"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+typedef struct _snd_pcm snd_pcm_t;
+
+namespace deepness
+{
+    /*! Talks to an ALSA hw device directly in mmap mode, without PortAudio's extra
+     *  buffering in between. The audio thread runs with SCHED_FIFO priority and an optional
+     *  cpu affinity, and the process memory is locked, so small periods like 32 or 16 frames
+     *  hold up. */
+    class AlsaBackend: public AudioBackend
+    {
+    public:
+        struct Settings
+        {
+            std::string device = "hw:0";
+            unsigned long bufferSamples = 64;
+            /*! periods in the hardware ring buffer, 2 gives the lowest latency */
+            unsigned int periods = 2;
+            int priority = 80;
+            /*! -1 doesn't pin the audio thread */
+            int cpu = -1;
+            bool lockMemory = true;
+        };
+
+        AlsaBackend(double sampleRate, Settings settings);
+        ~AlsaBackend();
+        AlsaBackend(AlsaBackend const&) =delete;
+        AlsaBackend & operator=(AlsaBackend const&) =delete;
+        void start(CallbackFunc callback) override;
+        void stop() override;
+        double getSampleRate() const override;
+    private:
+        struct Format
+        {
+            int format;
+            unsigned int channels;
+        };
+        snd_pcm_t *open(int stream, Format &format);
+        /*! \param started  set once the streams run, or to what kept them from starting */
+        void run(std::promise<void> &started);
+        void prepare();
+        void recover();
+        void readCapture(float *buffer, unsigned long frames);
+        void writePlayback(const float *buffer, unsigned long frames);
+
+        Settings m_settings;
+        double m_sampleRate;
+        snd_pcm_t *m_capture;
+        snd_pcm_t *m_playback;
+        Format m_captureFormat;
+        Format m_playbackFormat;
+        bool m_linked;
+        std::vector<float> m_input;
+        std::vector<float> m_output;
+        CallbackFunc m_callback;
+        std::atomic<bool> m_running;
+        std::atomic<unsigned long> m_xruns;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <string>
+
+namespace deepness
+{
+    /*! A source and sink of mono float audio that drives a callback.
+     *  The backend is opened by its constructor, so a failure to find a device shows up
+     *  before anything starts running. */
+    class AudioBackend
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                :m_message(std::move(message))
+            {}
+            const char *what() const noexcept
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+        using CallbackFunc = std::function<void (const float *inputBuffer, float *outputBuffer, unsigned long numSamples)>;
+
+        virtual ~AudioBackend() = default;
+        /*! Starts calling \a callback from the backend's audio thread. */
+        virtual void start(CallbackFunc callback) = 0;
+        /*! Stops calling the callback. It is not called anymore after this returns. */
+        virtual void stop() = 0;
+        virtual double getSampleRate() const = 0;
+    };
+}
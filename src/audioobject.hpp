@@ -1,44 +1,26 @@
 #pragma once
 
-#include <exception>
-#include <portaudio.h>
-#include <string>
-#include <functional>
+#include "audiobackend.hpp"
+#include <memory>
 
 namespace deepness
 {
     class AudioObject
     {
     public:
-        class Exception: public std::exception
-        {
-        public:
-            Exception(std::string message)
-                :m_message(std::move(message))
-            {}
-            const char *what() const noexcept
-            {
-                return m_message.c_str();
-            }
-        private:
-            std::string m_message;
-        };
-        using CallbackFunc = std::function<void (const float *inputBuffer, float *outputBuffer, unsigned long numSamples)>;
+        using Exception = AudioBackend::Exception;
+        using CallbackFunc = AudioBackend::CallbackFunc;
 
+        /*! Runs \a func on the default PortAudio devices. */
         AudioObject(CallbackFunc, double sampleRate = 48000);
+        AudioObject(CallbackFunc, std::unique_ptr<AudioBackend> backend);
         ~AudioObject();
         AudioObject(AudioObject const&) =delete;
         AudioObject & operator=(AudioObject const&) =delete;
         double getSampleRate() const;
+        AudioBackend &getBackend();
     private:
-        static int rawcallback(const void *inputBuffer,
-                               void *outputBuffer,
-                               unsigned long framesPerBuffer,
-                               const PaStreamCallbackTimeInfo* timeInfo,
-                               PaStreamCallbackFlags statusFlags,
-                               void *userData);
         static constexpr unsigned long s_bufferSampleLength = 64;
-        PaStream *m_stream;
-        CallbackFunc m_callback;
+        std::unique_ptr<AudioBackend> m_backend;
     };
 }
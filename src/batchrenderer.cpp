@@ -0,0 +1,315 @@
+#include "batchrenderer.hpp"
+#include "denormal.hpp"
+#include "soundreader.hpp"
+#include "soundwriter.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = boost::filesystem;
+
+namespace deepness
+{
+    namespace
+    {
+        // large enough that libsndfile reads and writes sequentially in big pieces
+        constexpr unsigned long s_chunkSamples = 1 << 16;
+        // chunks per direction, so the reader and writer can each run one chunk ahead
+        constexpr int s_chunksInFlight = 2;
+        // the tail ends once the output stays below -100 dB for this long
+        constexpr float s_silence = 1e-5f;
+        constexpr double s_quietSeconds = 2.;
+        constexpr double s_maxTailSeconds = 30.;
+
+        struct Chunk
+        {
+            std::vector<float> samples;
+            unsigned long count;
+        };
+
+        /*! Blocking queue handing chunks from one thread to another. */
+        class ChunkQueue
+        {
+        public:
+            void push(Chunk chunk)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_chunks.push_back(std::move(chunk));
+                }
+                m_available.notify_one();
+            }
+            /*! \returns false once closed and empty */
+            bool pop(Chunk &chunk)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_available.wait(lock, [this] { return m_closed || !m_chunks.empty(); });
+                if(m_chunks.empty())
+                    return false;
+                chunk = std::move(m_chunks.front());
+                m_chunks.pop_front();
+                return true;
+            }
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_closed = true;
+                }
+                m_available.notify_all();
+            }
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_available;
+            std::deque<Chunk> m_chunks;
+            bool m_closed = false;
+        };
+
+        bool isSoundFile(fs::path const& path)
+        {
+            static const std::set<std::string> extensions {".wav", ".flac", ".aif", ".aiff", ".ogg"};
+            return extensions.count(boost::algorithm::to_lower_copy(path.extension().string())) > 0;
+        }
+    }
+
+    BatchRenderer::BatchRenderer(GraphFactory factory, unsigned int threads, unsigned long blockSamples)
+        : m_factory(std::move(factory))
+        , m_threads(threads)
+        , m_blockSamples(blockSamples)
+    {}
+
+    BatchRenderer::Result BatchRenderer::render(std::vector<Job> const& jobs)
+    {
+        Result result;
+        std::atomic<std::uint64_t> samples(0);
+        std::atomic<unsigned long> failures(0);
+        std::mutex audioSecondsMutex;
+        auto begin = std::chrono::steady_clock::now();
+        {
+            ThreadPool pool(m_threads);
+            for(auto const& job: jobs)
+            {
+                pool.submit([&, job](unsigned int) {
+                        try
+                        {
+                            double sampleRate = 0.;
+                            auto rendered = renderFile(job, sampleRate);
+                            samples += rendered;
+                            std::lock_guard<std::mutex> lock(audioSecondsMutex);
+                            result.audioSeconds += rendered / sampleRate;
+                        }
+                        catch(std::exception const& e)
+                        {
+                            ++failures;
+                            std::cerr << "Error rendering " << job.input << ": " << e.what() << std::endl;
+                        }
+                    });
+            }
+            pool.wait();
+        }
+        result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        result.files = jobs.size();
+        result.failures = failures;
+        result.samples = samples;
+        return result;
+    }
+
+    std::uint64_t BatchRenderer::renderFile(Job const& job, double &sampleRate)
+    {
+        ScopedDenormalGuard guard;
+        SoundReader reader(job.input);
+        sampleRate = reader.getSampleRate();
+        auto transform = m_factory(sampleRate);
+        SoundWriter writer(job.output, sampleRate);
+
+        // one reader and one writer thread per file, decoding ahead and encoding behind while
+        // chunks circulate between them and this thread through the queues
+        ChunkQueue freeInput, readInput, freeOutput, renderedOutput;
+        for(auto i = 0; i < s_chunksInFlight; ++i)
+        {
+            freeInput.push(Chunk{std::vector<float>(s_chunkSamples), 0});
+            freeOutput.push(Chunk{std::vector<float>(s_chunkSamples), 0});
+        }
+        std::exception_ptr readError, writeError;
+        std::thread reading([&] {
+                Chunk chunk;
+                while(freeInput.pop(chunk))
+                {
+                    try
+                    {
+                        chunk.count = reader.read(chunk.samples.data(), s_chunkSamples);
+                    }
+                    catch(...)
+                    {
+                        readError = std::current_exception();
+                        chunk.count = 0;
+                    }
+                    auto end = chunk.count == 0;
+                    readInput.push(std::move(chunk));
+                    if(end)
+                        break;
+                }
+            });
+        std::thread writing([&] {
+                Chunk chunk;
+                while(renderedOutput.pop(chunk) && chunk.count > 0)
+                {
+                    // after an error keep taking chunks so the renderer never waits on us
+                    if(!writeError)
+                    {
+                        try
+                        {
+                            writer.write(chunk.samples.data(), chunk.count);
+                        }
+                        catch(...)
+                        {
+                            writeError = std::current_exception();
+                        }
+                    }
+                    freeOutput.push(std::move(chunk));
+                }
+            });
+        auto finish = [&] {
+            Chunk end{std::vector<float>(), 0};
+            renderedOutput.push(std::move(end));
+            freeInput.close();
+            reading.join();
+            writing.join();
+        };
+
+        std::vector<float> blockIn(m_blockSamples, 0.f);
+        std::vector<float> blockOut(m_blockSamples);
+        // output of the last, padded block that belongs to the tail
+        unsigned long carry = 0;
+        std::uint64_t total = 0;
+        try
+        {
+            Chunk input, output;
+            while(readInput.pop(input) && input.count > 0 && freeOutput.pop(output))
+            {
+                auto count = input.count;
+                auto *in = input.samples.data();
+                auto *out = output.samples.data();
+                unsigned long done = 0;
+                for(; done + m_blockSamples <= count; done += m_blockSamples)
+                    transform(in + done, out + done, m_blockSamples);
+                if(done < count)
+                {
+                    // the graph always sees whole blocks, the padding is the start of the tail
+                    std::fill(std::copy(in + done, in + count, blockIn.begin()), blockIn.end(), 0.f);
+                    transform(blockIn.data(), blockOut.data(), m_blockSamples);
+                    std::copy_n(blockOut.begin(), count - done, out + done);
+                    carry = m_blockSamples - (count - done);
+                }
+                output.count = count;
+                total += count;
+                freeInput.push(std::move(input));
+                renderedOutput.push(std::move(output));
+            }
+
+            // let delays and reverbs ring out: render silence until the output has been quiet
+            // for a while, or for at most the tail limit
+            std::fill(blockIn.begin(), blockIn.end(), 0.f);
+            auto quietLimit = static_cast<std::uint64_t>(s_quietSeconds * sampleRate);
+            auto tailLimit = static_cast<std::uint64_t>(s_maxTailSeconds * sampleRate);
+            std::uint64_t quiet = 0;
+            std::uint64_t tail = 0;
+            while(quiet < quietLimit && tail < tailLimit && !readError && freeOutput.pop(output))
+            {
+                auto *out = output.samples.data();
+                unsigned long count = 0;
+                if(carry > 0)
+                {
+                    count = std::copy_n(blockOut.end() - carry, carry, out) - out;
+                    carry = 0;
+                }
+                for(; count + m_blockSamples <= s_chunkSamples; count += m_blockSamples)
+                    transform(blockIn.data(), out + count, m_blockSamples);
+                for(unsigned long i = 0; i < count; ++i)
+                {
+                    quiet = std::abs(out[i]) > s_silence ? 0 : quiet + 1;
+                    if(quiet >= quietLimit)
+                    {
+                        // drop the quiet run that ended the tail as far as it's in this chunk
+                        count = i + 1 - static_cast<unsigned long>(std::min<std::uint64_t>(quiet, i + 1));
+                        break;
+                    }
+                    if(tail + i + 1 >= tailLimit)
+                    {
+                        count = i + 1;
+                        break;
+                    }
+                }
+                tail += count;
+                output.count = count;
+                if(count > 0)
+                    renderedOutput.push(std::move(output));
+            }
+            total += tail;
+        }
+        catch(...)
+        {
+            finish();
+            throw;
+        }
+        finish();
+        if(readError)
+            std::rethrow_exception(readError);
+        if(writeError)
+            std::rethrow_exception(writeError);
+        return total;
+    }
+
+    std::vector<BatchRenderer::Job> BatchRenderer::collect(std::vector<std::string> const& inputs, std::string const& outputDirectory)
+    {
+        std::vector<fs::path> files;
+        for(auto const& input: inputs)
+        {
+            fs::path path(input);
+            if(fs::is_directory(path))
+            {
+                std::vector<fs::path> directoryFiles;
+                for(auto it = fs::directory_iterator(path); it != fs::directory_iterator(); ++it)
+                {
+                    if(fs::is_regular_file(it->path()) && isSoundFile(it->path()))
+                        directoryFiles.push_back(it->path());
+                }
+                std::sort(directoryFiles.begin(), directoryFiles.end());
+                files.insert(files.end(), directoryFiles.begin(), directoryFiles.end());
+            }
+            else
+            {
+                files.push_back(std::move(path));
+            }
+        }
+        fs::path outputRoot(outputDirectory);
+        fs::create_directories(outputRoot);
+        std::vector<Job> jobs;
+        // x/a.wav and y/a.wav, or a.aiff and a.wav, would render to the same file; later
+        // ones get a -2, -3... suffix. Compared in lower case for case-insensitive filesystems.
+        std::set<std::string> taken;
+        for(auto const& file: files)
+        {
+            auto extension = boost::algorithm::to_lower_copy(file.extension().string()) == ".flac" ? ".flac" : ".wav";
+            auto stem = file.stem().string();
+            auto output = outputRoot / (stem + extension);
+            for(unsigned suffix = 2; !taken.insert(boost::algorithm::to_lower_copy(output.string())).second; ++suffix)
+                output = outputRoot / (stem + "-" + std::to_string(suffix) + extension);
+            if(fs::exists(file) && fs::exists(output) && fs::equivalent(file, output))
+                throw SoundWriter::Exception("Output would overwrite input " + file.string());
+            jobs.push_back(Job{file.string(), output.string()});
+        }
+        return jobs;
+    }
+}
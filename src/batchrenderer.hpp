@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace deepness
+{
+    /*! Renders many files through the effect graph in parallel. Every file gets its own
+     *  graph, built by the factory on the worker that renders it, so no state is shared
+     *  between workers and no tail leaks from one file into the next. Each file is rendered
+     *  past its end until the effect tail has died away. */
+    class BatchRenderer
+    {
+    public:
+        using Transform = std::function<void (const float *, float *, unsigned long samples)>;
+        using GraphFactory = std::function<Transform (double sampleRate)>;
+        struct Job
+        {
+            std::string input;
+            std::string output;
+        };
+        struct Result
+        {
+            unsigned long files = 0;
+            unsigned long failures = 0;
+            std::uint64_t samples = 0;
+            /*! sum of the durations of the rendered audio */
+            double audioSeconds = 0.;
+            double wallSeconds = 0.;
+        };
+
+        /*! \param threads  0 uses one per hardware thread
+         *  \param blockSamples  block size the graph is called with, like the audio callback */
+        BatchRenderer(GraphFactory factory, unsigned int threads = 0, unsigned long blockSamples = 64);
+        Result render(std::vector<Job> const& jobs);
+
+        /*! Expands directories to the sound files in them and maps every input to a file of
+         *  the same name in \a outputDirectory. Names that would collide get a -2, -3...
+         *  suffix in input order. */
+        static std::vector<Job> collect(std::vector<std::string> const& inputs, std::string const& outputDirectory);
+    private:
+        /*! \returns the number of samples rendered */
+        std::uint64_t renderFile(Job const& job, double &sampleRate);
+
+        GraphFactory m_factory;
+        unsigned int m_threads;
+        unsigned long m_blockSamples;
+    };
+}
@@ -0,0 +1,387 @@
+#include "audioobject.hpp"
+#include "effects.hpp"
+#include "fakeaudiobackend.hpp"
+#include "preset.hpp"
+#include "reblocker.hpp"
+#include "drone.hpp"
+#include "controls.hpp"
+#include "dynamics.hpp"
+#include "sessionrecorder.hpp"
+#include "waveshaper.hpp"
+#include "neuralamp.hpp"
+#include "reverb.hpp"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+
+using namespace deepness;
+using namespace std;
+
+namespace
+{
+    thread_local bool t_inCallback = false;
+    std::atomic<unsigned long> g_callbackAllocations(0);
+}
+
+// count heap allocations made from inside the audio callback, which must not happen
+void *operator new(std::size_t size)
+{
+    if(t_inCallback)
+        ++g_callbackAllocations;
+    if(auto *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    constexpr double s_sampleRate = 48000;
+    constexpr unsigned long s_bufferSamples = 64;
+    constexpr unsigned long s_warmupCallbacks = 16;
+    constexpr double s_maxDecayCost = 2.;
+
+    struct Scenario
+    {
+        std::string name;
+        std::function<SoundTransform ()> make;
+        std::function<FakeAudioBackend::Generator ()> input;
+        double seconds;
+        /*! also run with a short burst followed by silence and compare the cost */
+        bool decay;
+    };
+
+    /*! A sine for \a seconds, then silence. */
+    FakeAudioBackend::Generator burstInput(double seconds)
+    {
+        return [sine = FakeAudioBackend::sineInput(110., s_sampleRate), remaining = static_cast<unsigned long>(seconds * s_sampleRate)](float *buffer, unsigned long samples) mutable {
+            auto count = std::min(samples, remaining);
+            sine(buffer, count);
+            std::fill(buffer + count, buffer + samples, 0.f);
+            remaining -= count;
+        };
+    }
+
+    /*! \returns the mean callback time, or a negative value if the scenario failed */
+    double run(Scenario const& scenario, std::function<FakeAudioBackend::Generator ()> const& input, std::string const& name, bool realtime)
+    {
+        auto transform = scenario.make();
+        unsigned long callbacks = 0;
+        g_callbackAllocations = 0;
+        auto backend = std::make_unique<FakeAudioBackend>(input(),
+                                                          FakeAudioBackend::discardOutput(),
+                                                          s_sampleRate,
+                                                          s_bufferSamples,
+                                                          realtime,
+                                                          static_cast<unsigned long>(scenario.seconds * s_sampleRate));
+        auto *fake = backend.get();
+        {
+            AudioObject audio([&transform, &callbacks](const float *in, float *out, unsigned long samples) {
+                    t_inCallback = callbacks++ >= s_warmupCallbacks;
+                    transform(in, out, samples);
+                    t_inCallback = false;
+                }, std::move(backend));
+            fake->wait();
+        }
+        auto const& stats = fake->getStats();
+        auto allocations = g_callbackAllocations.load();
+        cout << left << setw(28) << name << right
+             << (realtime ? " realtime" : "     fast")
+             << fixed << setprecision(1)
+             << setw(10) << stats.realtimeFactor() << "x"
+             << setprecision(2)
+             << setw(10) << stats.callbackSeconds / stats.callbacks * 1e6 << " us"
+             << setw(10) << stats.maxCallbackSeconds * 1e6 << " us"
+             << setw(10) << stats.callbackStdDevSeconds * 1e6 << " us"
+             << setw(10) << stats.maxLatenessSeconds * 1e6 << " us"
+             << setw(8) << stats.deadlineMisses
+             << setw(8) << allocations << endl;
+        if(allocations != 0 || stats.realtimeFactor() <= 1.)
+            return -1.;
+        return stats.callbackSeconds / stats.callbacks;
+    }
+
+    bool run(Scenario const& scenario, bool realtime)
+    {
+        auto steady = run(scenario, scenario.input, scenario.name, realtime);
+        if(steady < 0.)
+            return false;
+        if(!scenario.decay)
+            return true;
+        // the state of recursive effects decays towards zero once the input goes silent;
+        // if it turns subnormal on the way, the callback gets many times more expensive
+        auto decay = run(scenario, [] { return burstInput(0.25); }, scenario.name + " decay", realtime);
+        if(decay < 0.)
+            return false;
+        if(decay > s_maxDecayCost * steady)
+        {
+            cout << scenario.name << ": silence costs " << decay / steady << " times the signal" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*! An LSTM amp model of \a hidden units with random weights, which cost the same as
+     *  trained ones. */
+    SoundTransform makeNeuralAmp(int hidden)
+    {
+        std::mt19937 generator(hidden);
+        std::normal_distribution<double> distribution(0., 0.3);
+        auto matrix = [&](int rows, int columns) {
+            json11::Json::array result;
+            for(int row = 0; row < rows; ++row)
+            {
+                json11::Json::array values;
+                for(int column = 0; column < columns; ++column)
+                    values.push_back(distribution(generator));
+                result.push_back(values);
+            }
+            return result;
+        };
+        auto vector = [&](int size) {
+            json11::Json::array result;
+            for(int i = 0; i < size; ++i)
+                result.push_back(distribution(generator));
+            return result;
+        };
+        return NeuralAmp(json11::Json::object {
+                {"model_data", json11::Json::object {
+                        {"unit_type", "LSTM"},
+                        {"hidden_size", hidden},
+                        {"skip", 1},
+                    }},
+                {"state_dict", json11::Json::object {
+                        {"rec.weight_ih_l0", matrix(4 * hidden, 1)},
+                        {"rec.weight_hh_l0", matrix(4 * hidden, hidden)},
+                        {"rec.bias_ih_l0", vector(4 * hidden)},
+                        {"rec.bias_hh_l0", vector(4 * hidden)},
+                        {"lin.weight", matrix(1, hidden)},
+                        {"lin.bias", vector(1)},
+                    }},
+            });
+    }
+
+    /*! The fuzz curve as a cubic table. */
+    SoundTransform makeFuzzWaveshaper(bool antialias)
+    {
+        Waveshaper::Settings settings;
+        settings.range = 2.f;
+        settings.size = 8192;
+        settings.interpolation = Waveshaper::Interpolation::Cubic;
+        settings.antialias = antialias;
+        auto waveshaper = std::make_shared<Waveshaper>(Waveshaper::parseExpression("sign(x) * abs(x)^0.7"), settings);
+        return [waveshaper](const float *in, float *out, unsigned long samples) {
+            (*waveshaper)(in, out, samples);
+        };
+    }
+}
+
+namespace
+{
+    /*! A steady sine above the threshold with makeup gain must meter the reduction the
+     *  static curve gives, without the makeup. */
+    bool checkGainReductionMeter()
+    {
+        Dynamics::Settings settings;
+        settings.thresholdDb = -20.f;
+        settings.ratio = 4.f;
+        settings.kneeDb = 0.f;
+        settings.makeupDb = 6.f;
+        auto meter = std::make_shared<std::atomic<float>>(0.f);
+        Dynamics dynamics(s_sampleRate, settings, meter);
+        const auto amplitude = 0.5f;
+        std::vector<float> in(static_cast<std::size_t>(s_sampleRate)), out(in.size());
+        for(std::size_t i = 0; i < in.size(); ++i)
+            in[i] = amplitude * static_cast<float>(std::sin(2. * M_PI * 1000. * i / s_sampleRate));
+        dynamics(in.data(), out.data(), in.size());
+        auto expected = -Dynamics::gainDb(settings, 20.f * std::log10(amplitude));
+        auto measured = meter->load();
+        if(std::fabs(measured - expected) > 0.5f)
+        {
+            cout << "gain reduction meter reads " << measured << " dB, expected " << expected << " dB" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*! A change at an odd offset must land on its sample without handing a block stage an
+     *  odd block: "octaveup" after a named gain has to match the input scaled by hand. */
+    bool checkControlsKeepBlocks()
+    {
+        const unsigned long block = 64;
+        const std::uint64_t at = 3 * block + 33;
+        Controls controls(s_sampleRate, block);
+        auto plan = Preset(json11::Json::object {{"chain", json11::Json::array {
+                            json11::Json::object {{"type", "gain"}, {"name", "level"}},
+                            json11::Json::object {{"type", "octaveup"}}}}}).instantiate(s_sampleRate, block, nullptr, &controls);
+        auto reference = Preset(json11::Json::object {{"chain", json11::Json::array {
+                            json11::Json::object {{"type", "octaveup"}}}}}).instantiate(s_sampleRate, block);
+        controls.post("level.gain", 0.5f, at);
+        std::vector<float> in(block), scaled(block), out(block), expected(block);
+        for(std::uint64_t time = 0; time < 8 * block; time += block)
+        {
+            for(unsigned long i = 0; i < block; ++i)
+            {
+                in[i] = static_cast<float>(std::sin(2. * M_PI * 440. * (time + i) / s_sampleRate));
+                scaled[i] = time + i < at ? in[i] : 0.5f * in[i];
+            }
+            std::fill(out.begin(), out.end(), std::numeric_limits<float>::quiet_NaN());
+            controls.process(in.data(), out.data(), block, plan);
+            reference(scaled.data(), expected.data(), block);
+            for(unsigned long i = 0; i < block; ++i)
+            {
+                if(!(std::fabs(out[i] - expected[i]) < 1e-6f))
+                {
+                    cout << "control change at an odd offset broke the block at sample " << time + i << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /*! An odd block after whole quanta moves the reblocker to its FIFO; the added latency
+     *  must fade in without a step larger than the sine's own. */
+    bool checkReblockerSwitch()
+    {
+        const unsigned long quantum = 64;
+        auto reblocked = reblock(quantum, [](const float *in, float *out, unsigned long samples) {
+                std::copy_n(in, samples, out);
+            }, quantum);
+        const double frequency = 1000.;
+        const auto maxStep = 1.1 * 2. * M_PI * frequency / s_sampleRate;
+        std::vector<float> in(2 * quantum), out(2 * quantum);
+        std::uint64_t time = 0;
+        auto previous = 0.f;
+        for(unsigned long samples: {2 * quantum, 2 * quantum, quantum - 27, quantum, 2 * quantum, quantum + 27})
+        {
+            for(unsigned long i = 0; i < samples; ++i)
+                in[i] = static_cast<float>(std::sin(2. * M_PI * frequency * (time + i) / s_sampleRate));
+            reblocked(in.data(), out.data(), samples);
+            for(unsigned long i = 0; i < samples; ++i)
+            {
+                if(std::fabs(out[i] - previous) > maxStep)
+                {
+                    cout << "reblocker jumped switching to its FIFO at sample " << time + i << endl;
+                    return false;
+                }
+                previous = out[i];
+            }
+            time += samples;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    auto sine = [] { return FakeAudioBackend::sineInput(110., s_sampleRate); };
+    std::vector<Scenario> scenarios {
+        {"passthrough", [] { return iterate(&passthrough); }, sine, 10., false},
+        {"fuzz", [] { return iterate(&fuzz); }, sine, 10., false},
+        {"fuzz waveshaper", [] { return makeFuzzWaveshaper(false); }, sine, 10., false},
+        {"fuzz waveshaper antialiased", [] { return makeFuzzWaveshaper(true); }, sine, 10., false},
+        {"delay", [] { return iterate(Delay(s_sampleRate)); }, sine, 20., true},
+        {"hipass lopass", [] { return chain({HiPass(s_sampleRate, 100.f), LoPass(s_sampleRate, 1000.f)}); }, sine, 10., true},
+        {"drone", [] { return iterate(Drone(s_sampleRate)); }, sine, 10., true},
+        {"octave down chain", [] {
+                return chain({WetDryMix(chain({
+                                    HiPass(s_sampleRate, 10.f)
+                                        , LoPass(s_sampleRate, 100.f)
+                                        , SquareOctaveDown(1)
+                                        , HiPass(s_sampleRate, 1000.f)
+                                        }), Mixer(0.1f))
+                            , iterate(combine(Compress(1.5f), &clip))});
+            }, sine, 10., true},
+        {"neural amp lstm 12", [] { return makeNeuralAmp(12); }, sine, 10., true},
+        {"reverb", [] {
+                auto reverb = std::make_shared<Reverb<8>>(s_sampleRate, Reverb<8>::Settings{});
+                return [reverb](const float *in, float *out, unsigned long samples) {
+                    (*reverb)(in, out, samples);
+                };
+            }, sine, 10., true},
+        {"compress (pow)", [] { return iterate(Compress(1.5f)); }, sine, 10., false},
+        {"gate compressor limiter", [] {
+                auto make = [](Dynamics::Mode mode, float thresholdDb, float lookaheadMs) -> SoundTransform {
+                    Dynamics::Settings settings;
+                    settings.mode = mode;
+                    settings.thresholdDb = thresholdDb;
+                    settings.lookaheadMs = lookaheadMs;
+                    return [dynamics = std::make_shared<Dynamics>(s_sampleRate, settings)](const float *in, float *out, unsigned long samples) {
+                        (*dynamics)(in, out, samples);
+                    };
+                };
+                return chain({make(Dynamics::Mode::Gate, -60.f, 0.f),
+                            make(Dynamics::Mode::Compressor, -20.f, 0.f),
+                            make(Dynamics::Mode::Limiter, -1.f, 1.f)});
+            }, sine, 10., true},
+        {"default preset", [] {
+                return Preset("presets/default.json", std::string()).instantiate(s_sampleRate);
+            }, sine, 10., false},
+        {"default preset recording", [] {
+                auto recorder = std::make_shared<SessionRecorder>(s_sampleRate);
+                recorder->start((boost::filesystem::temp_directory_path() / "pedal-bench.wav").string());
+                return [effects = Preset("presets/default.json", std::string()).instantiate(s_sampleRate), recorder](const float *in, float *out, unsigned long samples) mutable {
+                    effects(in, out, samples);
+                    (*recorder)(in, out, samples);
+                };
+            }, sine, 10., false},
+        {"reverb preset control events", [] {
+                auto controls = std::make_shared<Controls>(s_sampleRate, 64);
+                auto plan = Preset("presets/reverb.json", std::string()).instantiate(s_sampleRate, 4096, nullptr, controls.get());
+                return [controls, plan, time = std::uint64_t(0), toggle = false](const float *in, float *out, unsigned long samples) mutable {
+                    // an event in the middle of every block, the most splitting there is, posted
+                    // from the callback itself as posting takes no lock
+                    toggle = !toggle;
+                    controls->post("hallmix.mix", toggle ? 0.2f : 0.4f, time + samples / 2);
+                    controls->process(in, out, samples, plan);
+                    time += samples;
+                };
+            }, sine, 10., false},
+        {"pedalboard preset mostly off", [] {
+                return Preset("presets/pedalboard.json", std::string()).instantiate(s_sampleRate);
+            }, sine, 10., true},
+        {"pedalboard preset all on", [] {
+                auto controls = std::make_shared<Controls>(s_sampleRate, 64);
+                auto plan = Preset("presets/pedalboard.json", std::string()).instantiate(s_sampleRate, 4096, nullptr, controls.get());
+                for(auto const& name: {"comp.bypass", "drive.bypass", "fuzz.bypass", "octave.bypass"})
+                    controls->post(name, 0.f);
+                controls->post("delaymix.mix", 0.3f);
+                controls->post("hallmix.mix", 0.3f);
+                return [controls, plan](const float *in, float *out, unsigned long samples) mutable {
+                    controls->process(in, out, samples, plan);
+                };
+            }, sine, 10., false},
+        {"multiband preset", [] {
+                return Preset("presets/multiband.json", std::string()).instantiate(s_sampleRate);
+            }, sine, 10., false},
+        {"default preset quantum 32", [] {
+                return reblock(32, Preset("presets/default.json", std::string()).instantiate(s_sampleRate, 32), s_bufferSamples);
+            }, sine, 10., false},
+    };
+    auto realtime = argc > 1 && std::string(argv[1]) == "--realtime";
+    cout << left << setw(28) << "scenario" << right << "     mode"
+         << setw(11) << "speed" << setw(13) << "mean" << setw(13) << "max"
+         << setw(13) << "stddev" << setw(13) << "late" << setw(8) << "misses" << setw(8) << "allocs" << endl;
+    auto ok = checkGainReductionMeter();
+    ok = checkControlsKeepBlocks() && ok;
+    ok = checkReblockerSwitch() && ok;
+    for(auto const& scenario: scenarios)
+        ok = run(scenario, realtime) && ok;
+    return ok ? 0 : 1;
+}
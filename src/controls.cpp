@@ -0,0 +1,108 @@
+#include "controls.hpp"
+#include <algorithm>
+
+namespace deepness
+{
+    constexpr double Controls::s_maxAheadSeconds;
+
+    namespace
+    {
+        constexpr std::size_t s_eventQueueSize = 256;
+
+        std::int64_t nanoseconds(std::chrono::steady_clock::time_point time)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        }
+    }
+
+    Controls::Controls(double sampleRate, unsigned long scheduleAhead)
+        : m_sampleRate(sampleRate)
+        , m_scheduleAhead(scheduleAhead)
+        , m_events(s_eventQueueSize)
+        , m_time(0)
+        , m_clockSequence(0)
+        , m_clockTime(0)
+        , m_clockNanoseconds(nanoseconds(std::chrono::steady_clock::now()))
+    {
+        m_pending.reserve(m_events.capacity());
+        m_changes.reserve(m_events.capacity());
+    }
+
+    bool Controls::add(std::string const& name, Setter setter)
+    {
+        if(!m_names.emplace(name, static_cast<unsigned int>(m_setters.size())).second)
+            return false;
+        m_setters.push_back(std::move(setter));
+        return true;
+    }
+
+    std::vector<std::string> Controls::getNames() const
+    {
+        std::vector<std::string> names;
+        for(auto const& name: m_names)
+            names.push_back(name.first);
+        return names;
+    }
+
+    std::size_t Controls::size() const
+    {
+        return m_setters.size();
+    }
+
+    bool Controls::post(std::string const& name, float value, std::uint64_t at)
+    {
+        auto it = m_names.find(name);
+        if(it == m_names.end())
+            return false;
+        // a far future event would only sit in the way
+        auto latest = getTime() + m_scheduleAhead + static_cast<std::uint64_t>(s_maxAheadSeconds * m_sampleRate);
+        return m_events.push(Event{it->second, value, std::min(at, latest)});
+    }
+
+    std::uint64_t Controls::getTime() const
+    {
+        return m_clockTime.load(std::memory_order_acquire);
+    }
+
+    std::uint64_t Controls::timeAt(std::chrono::steady_clock::time_point when) const
+    {
+        unsigned int sequence;
+        std::uint64_t time;
+        std::int64_t clock;
+        do
+        {
+            sequence = m_clockSequence.load(std::memory_order_acquire);
+            time = m_clockTime.load(std::memory_order_relaxed);
+            clock = m_clockNanoseconds.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        while((sequence & 1) || sequence != m_clockSequence.load(std::memory_order_relaxed));
+        auto elapsed = std::max<std::int64_t>(0, nanoseconds(when) - clock);
+        return time + static_cast<std::uint64_t>(elapsed * 1e-9 * m_sampleRate) + m_scheduleAhead;
+    }
+
+    void Controls::schedule()
+    {
+        while(m_pending.size() < m_pending.capacity())
+        {
+            auto *event = m_events.front();
+            if(!event)
+                break;
+            auto position = std::upper_bound(m_pending.begin(), m_pending.end(), event->at, [](std::uint64_t at, Event const& pending) {
+                    return at < pending.at;
+                });
+            m_pending.insert(position, *event);
+            m_events.pop();
+        }
+    }
+
+    void Controls::publishClock()
+    {
+        auto sequence = m_clockSequence.load(std::memory_order_relaxed);
+        m_clockSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_clockTime.store(m_time, std::memory_order_relaxed);
+        m_clockNanoseconds.store(nanoseconds(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+        m_clockSequence.store(sequence + 2, std::memory_order_release);
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "mpscqueue.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace deepness
+{
+    /*! Named parameters of the effect graph, changed by timestamped events.
+     *
+     *  Stages register their parameters while the graph is built. Events are posted from any
+     *  thread with the sample time they take effect at, and the audio thread runs the effects
+     *  through process(), which hands them the changes due in the block with their offsets.
+     *  The effects apply each change through apply() where it suits them, a Plan splits its
+     *  per-sample steps so the change lands on its exact sample but keeps whole blocks for
+     *  the stages that need them. Setters only run on the audio thread.
+     *  Posting takes no lock, the names are fixed once the graph is built and the events
+     *  go through a lock-free queue, so the web server, MIDI input and the audio callback
+     *  itself can all post. With no events pending, a block costs one queue check and a
+     *  clock read. */
+    class Controls
+    {
+    public:
+        using Setter = std::function<void (float value)>;
+        /*! how far ahead events can be scheduled */
+        static constexpr double s_maxAheadSeconds = 10.;
+        /*! A change due in the block being processed, \a offset samples into it. */
+        struct Change
+        {
+            unsigned int control;
+            float value;
+            unsigned long offset;
+        };
+
+        /*! \param scheduleAhead  samples timeAt() adds, at least the callback size so that
+         *                        events aren't late for the block they arrive during */
+        Controls(double sampleRate, unsigned long scheduleAhead);
+        Controls(Controls const&) = delete;
+        Controls &operator=(Controls const&) = delete;
+
+        /*! Registers a parameter, only while the graph is built, before anything is posted.
+         *  \returns false if \a name is taken */
+        bool add(std::string const& name, Setter setter);
+        std::vector<std::string> getNames() const;
+        /*! The number of parameters, the next one added gets this index. */
+        std::size_t size() const;
+
+        /*! Sets \a name to \a value at sample time \a at, or at the start of the next block if
+         *  that has already passed, and at most s_maxAheadSeconds after the latest block. Events
+         *  are applied in the order of their times, those for the same sample in the order
+         *  they were posted, and an event due later never holds back one due earlier.
+         *  \returns false for unknown names or if the event queue is full */
+        bool post(std::string const& name, float value, std::uint64_t at = 0);
+        /*! Sample time at the start of the latest block. */
+        std::uint64_t getTime() const;
+        /*! The sample time for an event that happened at \a when: scheduleAhead after the
+         *  sample that was playing then, so events keep their spacing whatever the jitter of
+         *  the thread that saw them. */
+        std::uint64_t timeAt(std::chrono::steady_clock::time_point when) const;
+
+        /*! Audio thread, calls effects(in, out, samples, changes, count) with the changes due
+         *  in this block, in order and with non-decreasing offsets. */
+        template<typename Effects>
+        void process(const float *in, float *out, unsigned long samples, Effects &effects)
+        {
+            publishClock();
+            schedule();
+            m_changes.clear();
+            std::size_t due = 0;
+            for(; due < m_pending.size() && m_pending[due].at < m_time + samples; ++due)
+            {
+                auto const& event = m_pending[due];
+                auto offset = event.at > m_time ? static_cast<unsigned long>(event.at - m_time) : 0ul;
+                m_changes.push_back(Change{event.control, event.value, offset});
+            }
+            m_pending.erase(m_pending.begin(), m_pending.begin() + static_cast<std::ptrdiff_t>(due));
+            effects(in, out, samples, m_changes.data(), m_changes.size());
+            m_time += samples;
+        }
+        /*! Audio thread, from the effects called by process(). */
+        void apply(Change const& change)
+        {
+            m_setters[change.control](change.value);
+        }
+    private:
+        struct Event
+        {
+            unsigned int control;
+            float value;
+            std::uint64_t at;
+        };
+
+        void publishClock();
+        /*! Moves posted events to m_pending, keeping it sorted by time. */
+        void schedule();
+
+        double m_sampleRate;
+        unsigned long m_scheduleAhead;
+        std::vector<Setter> m_setters;
+        std::map<std::string, unsigned int> m_names;
+        MpscQueue<Event> m_events;
+
+        // audio thread
+        std::uint64_t m_time;
+        /*! events taken off the queue, by time; both reserved for a full queue */
+        std::vector<Event> m_pending;
+        std::vector<Change> m_changes;
+
+        // sample time and clock at the start of the latest block, a seqlock as they go together
+        std::atomic<unsigned int> m_clockSequence;
+        std::atomic<std::uint64_t> m_clockTime;
+        std::atomic<std::int64_t> m_clockNanoseconds;
+    };
+}
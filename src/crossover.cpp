@@ -0,0 +1,114 @@
+#include "crossover.hpp"
+#include "denormal.hpp"
+#include <cmath>
+
+namespace deepness
+{
+    constexpr unsigned int Crossover::s_maxBands;
+
+    namespace
+    {
+        enum class Response
+        {
+            Through,
+            LowPass,
+            HighPass,
+            AllPass,
+        };
+
+        /*! Butterworth (Q = 1/sqrt(2)) biquad coefficients b0, b1, b2, a1, a2. */
+        std::array<float, 5> coefficients(Response response, double sampleRate, double frequency)
+        {
+            auto w0 = 2. * M_PI * frequency / sampleRate;
+            auto cosw = std::cos(w0);
+            auto alpha = std::sin(w0) / std::sqrt(2.);
+            auto a0 = 1. + alpha;
+            std::array<double, 3> b;
+            switch(response)
+            {
+            case Response::Through:
+                return {{1.f, 0.f, 0.f, 0.f, 0.f}};
+            case Response::LowPass:
+                b = {{(1. - cosw) / 2., 1. - cosw, (1. - cosw) / 2.}};
+                break;
+            case Response::HighPass:
+                b = {{(1. + cosw) / 2., -(1. + cosw), (1. + cosw) / 2.}};
+                break;
+            case Response::AllPass:
+                b = {{1. - alpha, -2. * cosw, 1. + alpha}};
+                break;
+            }
+            return {{static_cast<float>(b[0] / a0), static_cast<float>(b[1] / a0), static_cast<float>(b[2] / a0),
+                     static_cast<float>(-2. * cosw / a0), static_cast<float>((1. - alpha) / a0)}};
+        }
+    }
+
+    Crossover::Crossover(double sampleRate, std::vector<float> const& frequencies)
+        : m_bands(static_cast<unsigned int>(frequencies.size() + 1))
+    {
+        if(m_bands > s_maxBands)
+            throw Exception("At most " + std::to_string(s_maxBands) + " bands are supported");
+        for(std::size_t i = 0; i < frequencies.size(); ++i)
+        {
+            if(frequencies[i] <= 0.f || frequencies[i] >= sampleRate / 2. || (i > 0 && frequencies[i] <= frequencies[i - 1]))
+                throw Exception("Crossover frequencies must increase and lie below half the sample rate");
+        }
+        // a Linkwitz-Riley section is two Butterworth biquads; its allpass needs only one
+        m_sections.resize(2 * frequencies.size());
+        for(std::size_t crossing = 0; crossing < frequencies.size(); ++crossing)
+        {
+            for(unsigned int half = 0; half < 2; ++half)
+            {
+                auto &section = m_sections[2 * crossing + half];
+                for(unsigned int band = 0; band < s_maxBands; ++band)
+                {
+                    auto response = Response::Through;
+                    if(band < m_bands)
+                    {
+                        if(band > crossing)
+                            response = Response::HighPass;
+                        else if(band == crossing)
+                            response = Response::LowPass;
+                        else if(half == 0)
+                            response = Response::AllPass;
+                    }
+                    auto c = coefficients(response, sampleRate, frequencies[crossing]);
+                    section.b0[band] = c[0];
+                    section.b1[band] = c[1];
+                    section.b2[band] = c[2];
+                    section.a1[band] = c[3];
+                    section.a2[band] = c[4];
+                    section.z1[band] = 0.f;
+                    section.z2[band] = 0.f;
+                }
+            }
+        }
+    }
+
+    void Crossover::operator()(const float *in, float *const *bands, unsigned long samples)
+    {
+        for(decltype(samples) i = 0; i < samples; ++i)
+        {
+            alignas(32) Lanes value;
+            value.fill(in[i]);
+            for(auto &section: m_sections)
+            {
+                for(unsigned int band = 0; band < s_maxBands; ++band)
+                {
+                    auto x = value[band];
+                    auto y = section.b0[band] * x + section.z1[band];
+                    section.z1[band] = flushDenormal(section.b1[band] * x - section.a1[band] * y + section.z2[band]);
+                    section.z2[band] = flushDenormal(section.b2[band] * x - section.a2[band] * y);
+                    value[band] = y;
+                }
+            }
+            for(unsigned int band = 0; band < m_bands; ++band)
+                bands[band][i] = value[band];
+        }
+    }
+
+    unsigned int Crossover::getBands() const
+    {
+        return m_bands;
+    }
+}
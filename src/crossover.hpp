@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace deepness
+{
+    /*! Splits a signal into bands with 4th order Linkwitz-Riley filters. The bands add up to
+     *  an allpass of the input, so they can be processed separately and summed back without
+     *  the crossover colouring the sound.
+     *
+     *  Instead of a tree of splits, every band is its own cascade of one section per
+     *  crossover frequency: highpasses below the band, a lowpass above it and allpasses
+     *  further up matching the phase of the other bands. All cascades have the same shape,
+     *  so they run in lockstep with one vector lane per band. */
+    class Crossover
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+        static constexpr unsigned int s_maxBands = 8;
+
+        /*! \param frequencies  increasing, one less than the number of bands */
+        Crossover(double sampleRate, std::vector<float> const& frequencies);
+        /*! \param bands  getBands() outputs */
+        void operator()(const float *in, float *const *bands, unsigned long samples);
+        unsigned int getBands() const;
+    private:
+        using Lanes = std::array<float, s_maxBands>;
+        /*! A biquad per lane, in transposed direct form II. */
+        struct Section
+        {
+            Lanes b0, b1, b2, a1, a2;
+            Lanes z1, z2;
+        };
+
+        unsigned int m_bands;
+        std::vector<Section> m_sections;
+    };
+}
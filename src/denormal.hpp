@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cmath>
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+namespace deepness
+{
+    /*! Makes the cpu flush subnormal floats to zero (FTZ) and treat subnormal inputs as
+     *  zero (DAZ) until it goes out of scope. Subnormals show up when recursive state decays
+     *  in silence, and every operation on them costs many times a normal one. */
+    class ScopedDenormalGuard
+    {
+    public:
+        ScopedDenormalGuard() noexcept
+        {
+#if defined(__SSE__) || defined(__x86_64__)
+            m_state = _mm_getcsr();
+            // 0x8000 is FTZ, 0x0040 DAZ
+            _mm_setcsr(m_state | 0x8040);
+#elif defined(__aarch64__)
+            asm volatile("mrs %0, fpcr" : "=r"(m_state));
+            // bit 24 is FZ
+            asm volatile("msr fpcr, %0" : : "r"(m_state | (1ull << 24)));
+#endif
+        }
+        ~ScopedDenormalGuard() noexcept
+        {
+#if defined(__SSE__) || defined(__x86_64__)
+            _mm_setcsr(m_state);
+#elif defined(__aarch64__)
+            asm volatile("msr fpcr, %0" : : "r"(m_state));
+#endif
+        }
+        ScopedDenormalGuard(ScopedDenormalGuard const&) = delete;
+        ScopedDenormalGuard &operator=(ScopedDenormalGuard const&) = delete;
+    private:
+#if defined(__aarch64__)
+        unsigned long long m_state;
+#else
+        unsigned int m_state = 0;
+#endif
+    };
+
+    /*! Zeroes values too small to be heard, long before they become subnormal. Used on
+     *  the state of recursive effects, so they stay cheap in silence on any platform. */
+    inline float flushDenormal(float value)
+    {
+        return std::fabs(value) < 1e-15f ? 0.f : value;
+    }
+}
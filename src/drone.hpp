@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <array>
+#include "denormal.hpp"
 
 namespace deepness
 {
@@ -36,8 +37,8 @@ namespace deepness
                 auto acceleration = (stringForce + dampeningForce) / m_inertia;
                 auto &nextBuffer = m_buffers[(m_bufferIndex + 1) % 2];
 
-                nextBuffer[i].velocity = buffer[i].velocity + acceleration * m_samplePeriod;
-                nextBuffer[i].position = buffer[i].position + nextBuffer[i].velocity * m_samplePeriod;
+                nextBuffer[i].velocity = flushDenormal(buffer[i].velocity + acceleration * m_samplePeriod);
+                nextBuffer[i].position = flushDenormal(buffer[i].position + nextBuffer[i].velocity * m_samplePeriod);
             }
         }
 
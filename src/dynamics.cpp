@@ -0,0 +1,195 @@
+#include "dynamics.hpp"
+#include "denormal.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace deepness
+{
+    namespace
+    {
+        constexpr unsigned long s_chunkSamples = 256;
+        // the envelope and gain run at this control interval
+        constexpr unsigned long s_groupSamples = 8;
+        // envelope range covered by the table, everything outside is clamped
+        constexpr float s_tableMin = 1e-8f;
+        constexpr float s_tableMax = 64.f;
+        // 7 mantissa bits stay, 128 steps per octave or about 0.05 dB
+        constexpr unsigned int s_tableShift = 16;
+
+        /*! One pole coefficients for advancing the envelope 1 to s_groupSamples samples at once. */
+        std::vector<float> coefficients(float milliseconds, double sampleRate)
+        {
+            std::vector<float> result(s_groupSamples, 0.f);
+            if(milliseconds > 0.f)
+            {
+                for(unsigned long i = 0; i < s_groupSamples; ++i)
+                    result[i] = static_cast<float>(std::exp(-(i + 1.) / (milliseconds * 0.001 * sampleRate)));
+            }
+            return result;
+        }
+    }
+
+    Dynamics::Dynamics(double sampleRate, Settings settings, std::shared_ptr<std::atomic<float>> gainReduction)
+        : m_settings(settings)
+        , m_attack(coefficients(settings.attackMs, sampleRate))
+        , m_release(coefficients(settings.releaseMs, sampleRate))
+        , m_envelope(0.f)
+        , m_gain(1.f)
+        , m_makeup(std::pow(10.f, settings.makeupDb / 20.f))
+        , m_tableOffset(bits(s_tableMin) >> s_tableShift)
+        , m_lookahead(std::max<std::size_t>(1, static_cast<std::size_t>(settings.lookaheadMs * 0.001 * sampleRate)), 0.f)
+        , m_lookaheadPos(0)
+        , m_detector(s_chunkSamples)
+        , m_delayed(s_chunkSamples)
+        , m_gainReduction(std::move(gainReduction))
+    {
+        if(settings.lookaheadMs <= 0.f)
+            m_lookahead.clear();
+        auto size = (bits(s_tableMax) >> s_tableShift) - m_tableOffset + 1;
+        m_table.resize(size);
+        for(decltype(size) i = 0; i < size; ++i)
+        {
+            // the middle of the range of envelope values mapping to this entry
+            auto representative = ((i + m_tableOffset) << s_tableShift) | (1u << (s_tableShift - 1));
+            float level;
+            std::memcpy(&level, &representative, sizeof(level));
+            auto levelDb = settings.detector == Detector::Rms ? 10.f * std::log10(level) : 20.f * std::log10(level);
+            m_table[i] = std::pow(10.f, gainDb(settings, levelDb) / 20.f);
+        }
+    }
+
+    unsigned int Dynamics::bits(float value)
+    {
+        unsigned int result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+
+    float Dynamics::gainDb(Settings const& settings, float levelDb)
+    {
+        auto threshold = settings.thresholdDb;
+        auto knee = std::max(settings.kneeDb, 0.f);
+        auto over = levelDb - threshold;
+        switch(settings.mode)
+        {
+        case Mode::Compressor:
+        case Mode::Limiter:
+        {
+            auto slope = settings.mode == Mode::Limiter ? 0.f : 1.f / std::max(settings.ratio, 1.f);
+            if(knee <= 0.f)
+                return over > 0.f ? (slope - 1.f) * over : 0.f;
+            if(2.f * over < -knee)
+                return 0.f;
+            if(2.f * over <= knee)
+            {
+                auto x = over + knee / 2.f;
+                return (slope - 1.f) * x * x / (2.f * knee);
+            }
+            return (slope - 1.f) * over;
+        }
+        case Mode::Gate:
+        {
+            auto ratio = std::max(settings.ratio, 1.f);
+            float gain;
+            if(knee <= 0.f)
+                gain = over < 0.f ? (ratio - 1.f) * over : 0.f;
+            else if(2.f * over > knee)
+                gain = 0.f;
+            else if(2.f * over >= -knee)
+            {
+                auto x = over - knee / 2.f;
+                gain = -(ratio - 1.f) * x * x / (2.f * knee);
+            }
+            else
+                gain = (ratio - 1.f) * over;
+            return std::max(gain, settings.rangeDb);
+        }
+        }
+        return 0.f;
+    }
+
+    void Dynamics::operator()(const float *in, float *out, unsigned long samples)
+    {
+        while(samples)
+        {
+            auto count = std::min(samples, s_chunkSamples);
+            process(in, out, count);
+            in += count;
+            out += count;
+            samples -= count;
+        }
+    }
+
+    void Dynamics::process(const float *in, float *out, unsigned long samples)
+    {
+        // the detector reduces every group of samples to one control value
+        auto *control = m_detector.data();
+        auto groups = (samples + s_groupSamples - 1) / s_groupSamples;
+        for(decltype(groups) group = 0; group < groups; ++group)
+        {
+            auto begin = group * s_groupSamples;
+            auto end = std::min(begin + s_groupSamples, samples);
+            auto value = 0.f;
+            if(m_settings.detector == Detector::Rms)
+            {
+                for(auto i = begin; i < end; ++i)
+                    value += in[i] * in[i];
+                value /= end - begin;
+            }
+            else
+            {
+                for(auto i = begin; i < end; ++i)
+                    value = std::max(value, std::fabs(in[i]));
+            }
+            control[group] = value;
+        }
+
+        // the only recursive part, run once per group
+        auto envelope = m_envelope;
+        auto last = static_cast<unsigned int>(m_table.size() - 1);
+        for(decltype(groups) group = 0; group < groups; ++group)
+        {
+            auto count = std::min(s_groupSamples, samples - group * s_groupSamples) - 1;
+            auto detector = control[group];
+            auto coefficient = detector > envelope ? m_attack[count] : m_release[count];
+            envelope = detector + coefficient * (envelope - detector);
+            auto value = std::min(std::max(envelope, s_tableMin), s_tableMax);
+            control[group] = m_table[std::min((bits(value) >> s_tableShift) - m_tableOffset, last)];
+        }
+        m_envelope = flushDenormal(envelope);
+
+        const float *signal = in;
+        if(!m_lookahead.empty())
+        {
+            auto *delayed = m_delayed.data();
+            auto size = m_lookahead.size();
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                delayed[i] = m_lookahead[m_lookaheadPos];
+                m_lookahead[m_lookaheadPos] = in[i];
+                m_lookaheadPos = m_lookaheadPos + 1 == size ? 0 : m_lookaheadPos + 1;
+            }
+            signal = delayed;
+        }
+
+        // ramp linearly from the previous group's gain so there is no zipper noise, the makeup
+        // stays out of the table so the meter sees only the reduction
+        auto gain = m_gain;
+        auto makeup = m_makeup;
+        auto minGain = groups ? control[0] : gain;
+        for(decltype(groups) group = 0; group < groups; ++group)
+        {
+            auto begin = group * s_groupSamples;
+            auto end = std::min(begin + s_groupSamples, samples);
+            auto step = (control[group] - gain) / (end - begin);
+            for(auto i = begin; i < end; ++i)
+                out[i] = signal[i] * makeup * (gain + step * (i - begin + 1));
+            gain = control[group];
+            minGain = std::min(minGain, gain);
+        }
+        m_gain = gain;
+        if(m_gainReduction)
+            m_gainReduction->store(20.f * std::log10(1.f / std::max(minGain, 1e-6f)), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace deepness
+{
+    /*! Compressor, limiter or noise gate driven by an attack/release envelope follower.
+     *
+     *  Blocks are processed in passes: the detector reduces each group of 8 samples to its
+     *  peak or mean square, the envelope follows those at the control rate, and the gain is
+     *  ramped across each group while it's applied. The static curve, including the soft knee
+     *  and the dB conversion, is tabulated once and indexed by the exponent and top mantissa
+     *  bits of the envelope, so there is no log or pow per sample. With lookahead the signal
+     *  is delayed so the gain can come down before a transient arrives. */
+    class Dynamics
+    {
+    public:
+        enum class Mode
+        {
+            Compressor,
+            Limiter,
+            /*! downward expander, with a large ratio a gate */
+            Gate,
+        };
+        enum class Detector
+        {
+            Peak,
+            Rms,
+        };
+        struct Settings
+        {
+            Mode mode = Mode::Compressor;
+            Detector detector = Detector::Peak;
+            float thresholdDb = -20.f;
+            /*! compressor: input dB per output dB above the threshold, gate: output dB per input dB below it */
+            float ratio = 4.f;
+            float kneeDb = 6.f;
+            float attackMs = 5.f;
+            float releaseMs = 100.f;
+            float lookaheadMs = 0.f;
+            float makeupDb = 0.f;
+            /*! gate only: the most it attenuates */
+            float rangeDb = -80.f;
+        };
+
+        /*! \param gainReduction  receives the largest gain reduction of every block in dB */
+        Dynamics(double sampleRate, Settings settings, std::shared_ptr<std::atomic<float>> gainReduction = nullptr);
+        void operator()(const float *in, float *out, unsigned long samples);
+
+        /*! The curve the table is built from, level and result in dB. */
+        static float gainDb(Settings const& settings, float levelDb);
+    private:
+        void process(const float *in, float *out, unsigned long samples);
+        static unsigned int bits(float value);
+
+        Settings m_settings;
+        std::vector<float> m_attack;
+        std::vector<float> m_release;
+        float m_envelope;
+        float m_gain;
+        float m_makeup;
+        std::vector<float> m_table;
+        unsigned int m_tableOffset;
+        std::vector<float> m_lookahead;
+        std::size_t m_lookaheadPos;
+        std::vector<float> m_detector;
+        std::vector<float> m_delayed;
+        std::shared_ptr<std::atomic<float>> m_gainReduction;
+    };
+}
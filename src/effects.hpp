@@ -4,6 +4,7 @@
 #include <vector>
 #include <functional>
 #include "soundloop.hpp"
+#include "denormal.hpp"
 #include <cassert>
 
 namespace deepness
@@ -32,12 +33,12 @@ namespace deepness
         };
     }
 
-    float passthrough(float in)
+    inline float passthrough(float in)
     {
         return in;
     }
 
-    float fuzz(float in)
+    inline float fuzz(float in)
     {
         return sign(in) * std::pow(std::abs(in), 0.7f);
     }
@@ -82,7 +83,7 @@ namespace deepness
         {
             m_pos = (m_pos + 1) % m_samples.size();
             auto inpos = (m_pos - 1) % m_samples.size();
-            auto output = 0.9f * in + 0.5f * m_samples[m_pos];
+            auto output = flushDenormal(0.9f * in + 0.5f * m_samples[m_pos]);
             m_samples[inpos] = output;
             return output;
         }
@@ -92,12 +93,12 @@ namespace deepness
         double m_sampleRate;
     };
 
-    float clip(float in)
+    inline float clip(float in)
     {
         return in < -1.f ? -1.f : in > 1.f ? 1.f : in;
     }
 
-    SoundTransform iterate(std::function<float (float in)> func)
+    inline SoundTransform iterate(std::function<float (float in)> func)
     {
         return [func = std::move(func)](const float *in, float *out, unsigned long samples)
         {
@@ -106,7 +107,7 @@ namespace deepness
         };
     }
 
-    std::function<void (const float *, float *, unsigned long)> chain(std::vector<std::function<void (const float *, float *, unsigned long)>> transforms)
+    inline std::function<void (const float *, float *, unsigned long)> chain(std::vector<std::function<void (const float *, float *, unsigned long)>> transforms)
     {
         return [transforms = std::move(transforms), buffer = std::vector<float>()](const float * input, float * output, unsigned long samples) mutable
         {
@@ -151,7 +152,7 @@ namespace deepness
         SoundLoop m_soundLoop;
     };
 
-    void linearResample(const float *in, unsigned long inSamples, float *out, unsigned long outSamples)
+    inline void linearResample(const float *in, unsigned long inSamples, float *out, unsigned long outSamples)
     {
         for(unsigned long i = 0; i < outSamples; ++i)
         {
@@ -165,7 +166,7 @@ namespace deepness
     }
 
 /*! make the sample half as long. */
-    void boxResample(const float *in, unsigned long inSamples, float *out, unsigned long outSamples)
+    inline void boxResample(const float *in, unsigned long inSamples, float *out, unsigned long outSamples)
     {
         assert(inSamples == 2 * outSamples);
         for(decltype(outSamples) i = 0; i < outSamples; ++i)
@@ -182,7 +183,7 @@ namespace deepness
         }
     };
 
-    std::function<float (float)> SquareOctaveDownSample(int octaves = 1)
+    inline std::function<float (float)> SquareOctaveDownSample(int octaves = 1)
     {
         return [oldvalue = 1.f, stateinit = std::pow(2, octaves), state = 0](float in) mutable {
             if(state < 0 && in > 0 && oldvalue < 0)
@@ -202,12 +203,12 @@ namespace deepness
             return state > 0 ? 1.f : -1.f;
         };
     }
-    SoundTransform SquareOctaveDown(int octaves = 1)
+    inline SoundTransform SquareOctaveDown(int octaves = 1)
     {
         return iterate(SquareOctaveDownSample(octaves));
     }
 
-    SoundTransform SquareMultiplexOctaveDown(int octaves = 1)
+    inline SoundTransform SquareMultiplexOctaveDown(int octaves = 1)
     {
         return iterate([samplefunc = SquareOctaveDownSample(octaves)](float in) {
                 return samplefunc(in) * in;
@@ -232,28 +233,38 @@ namespace deepness
     };
 
 // make sure you put a hipass after this
-    SoundTransform AbsOctaveUp()
+    inline SoundTransform AbsOctaveUp()
     {
         return iterate([](float in) {
                 return fabs(in);
             });
     }
 
-    SoundTransform HiPass(double sampleRate, float amount)
+    inline std::function<float (float)> HiPassSample(double sampleRate, float amount)
     {
-        return iterate([sampleRate, amount, accumulation = 0.f](float in) mutable {
+        return [sampleRate, amount, accumulation = 0.f](float in) mutable {
                 auto adjustedAmount = static_cast<float>(amount / sampleRate);
-                accumulation = in * adjustedAmount + (1.f - adjustedAmount) * accumulation;
+                accumulation = flushDenormal(in * adjustedAmount + (1.f - adjustedAmount) * accumulation);
                 return in - accumulation;
-            });
+            };
+    }
+
+    inline SoundTransform HiPass(double sampleRate, float amount)
+    {
+        return iterate(HiPassSample(sampleRate, amount));
     }
 
-    SoundTransform LoPass(double sampleRate, float amount)
+    inline std::function<float (float)> LoPassSample(double sampleRate, float amount)
     {
-        return iterate([adjustedAmount = static_cast<float>((sampleRate - amount) / sampleRate), accumulation = 0.f](float in) mutable {
-                accumulation = in * adjustedAmount + (1.f - adjustedAmount) * accumulation;
+        return [adjustedAmount = static_cast<float>((sampleRate - amount) / sampleRate), accumulation = 0.f](float in) mutable {
+                accumulation = flushDenormal(in * adjustedAmount + (1.f - adjustedAmount) * accumulation);
                 return accumulation;
-            });
+            };
+    }
+
+    inline SoundTransform LoPass(double sampleRate, float amount)
+    {
+        return iterate(LoPassSample(sampleRate, amount));
     }
 
     class SplitCombine
@@ -0,0 +1,157 @@
+#include "fakeaudiobackend.hpp"
+#include "soundloop.hpp"
+#include "soundwriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+namespace deepness
+{
+    double FakeAudioBackend::Stats::realtimeFactor() const
+    {
+        if(callbackSeconds <= 0.)
+            return 0.;
+        return samples / sampleRate / callbackSeconds;
+    }
+
+    FakeAudioBackend::FakeAudioBackend(Generator input,
+                                       Sink output,
+                                       double sampleRate,
+                                       unsigned long bufferSamples,
+                                       bool realtime,
+                                       unsigned long lengthSamples)
+        : m_input(std::move(input))
+        , m_output(std::move(output))
+        , m_sampleRate(sampleRate)
+        , m_bufferSamples(bufferSamples)
+        , m_realtime(realtime)
+        , m_lengthSamples(lengthSamples)
+        , m_running(false)
+    {
+        m_stats.sampleRate = sampleRate;
+    }
+
+    FakeAudioBackend::~FakeAudioBackend()
+    {
+        stop();
+    }
+
+    void FakeAudioBackend::start(CallbackFunc callback)
+    {
+        if(m_thread.joinable())
+            throw Exception("Fake audio backend already started");
+        m_callback = std::move(callback);
+        m_stats = Stats();
+        m_stats.sampleRate = m_sampleRate;
+        m_running = true;
+        m_thread = std::thread([this] {
+                run();
+            });
+    }
+
+    void FakeAudioBackend::stop()
+    {
+        m_running = false;
+        wait();
+    }
+
+    void FakeAudioBackend::wait()
+    {
+        if(m_thread.joinable())
+            m_thread.join();
+    }
+
+    double FakeAudioBackend::getSampleRate() const
+    {
+        return m_sampleRate;
+    }
+
+    FakeAudioBackend::Stats const& FakeAudioBackend::getStats() const
+    {
+        return m_stats;
+    }
+
+    void FakeAudioBackend::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        using Seconds = std::chrono::duration<double>;
+        std::vector<float> input(m_bufferSamples, 0.f);
+        std::vector<float> output(m_bufferSamples, 0.f);
+        auto period = Seconds(m_bufferSamples / m_sampleRate);
+        auto begin = Clock::now();
+        auto deadline = begin;
+        // running mean and variance of the callback duration, Welford's method
+        double mean = 0.;
+        double m2 = 0.;
+        while(m_running && (!m_lengthSamples || m_stats.samples < m_lengthSamples))
+        {
+            m_input(input.data(), m_bufferSamples);
+            if(m_realtime)
+            {
+                deadline += std::chrono::duration_cast<Clock::duration>(period);
+                std::this_thread::sleep_until(deadline);
+                auto lateness = Seconds(Clock::now() - deadline).count();
+                m_stats.maxLatenessSeconds = std::max(m_stats.maxLatenessSeconds, lateness);
+            }
+            auto callbackBegin = Clock::now();
+            m_callback(input.data(), output.data(), m_bufferSamples);
+            auto callbackEnd = Clock::now();
+            auto duration = Seconds(callbackEnd - callbackBegin).count();
+
+            ++m_stats.callbacks;
+            m_stats.samples += m_bufferSamples;
+            m_stats.callbackSeconds += duration;
+            m_stats.maxCallbackSeconds = std::max(m_stats.maxCallbackSeconds, duration);
+            if(duration > period.count())
+                ++m_stats.deadlineMisses;
+            auto delta = duration - mean;
+            mean += delta / m_stats.callbacks;
+            m2 += delta * (duration - mean);
+            m_stats.wallSeconds = Seconds(callbackEnd - begin).count();
+
+            m_output(output.data(), m_bufferSamples);
+        }
+        if(m_stats.callbacks > 1)
+            m_stats.callbackStdDevSeconds = std::sqrt(m2 / (m_stats.callbacks - 1));
+    }
+
+    FakeAudioBackend::Generator FakeAudioBackend::fileInput(std::string const& filename)
+    {
+        auto loop = std::make_shared<SoundLoop>(filename);
+        return [loop](float *buffer, unsigned long samples) {
+            loop->read(buffer, samples);
+        };
+    }
+
+    FakeAudioBackend::Generator FakeAudioBackend::sineInput(double frequency, double sampleRate, float amplitude)
+    {
+        return [step = 2. * M_PI * frequency / sampleRate, amplitude, phase = 0.](float *buffer, unsigned long samples) mutable {
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                buffer[i] = amplitude * static_cast<float>(std::sin(phase));
+                phase = std::fmod(phase + step, 2. * M_PI);
+            }
+        };
+    }
+
+    FakeAudioBackend::Generator FakeAudioBackend::silentInput()
+    {
+        return [](float *buffer, unsigned long samples) {
+            std::fill_n(buffer, samples, 0.f);
+        };
+    }
+
+    FakeAudioBackend::Sink FakeAudioBackend::fileOutput(std::string const& filename, double sampleRate)
+    {
+        auto writer = std::make_shared<SoundWriter>(filename, sampleRate);
+        return [writer](const float *buffer, unsigned long samples) {
+            writer->write(buffer, samples);
+        };
+    }
+
+    FakeAudioBackend::Sink FakeAudioBackend::discardOutput()
+    {
+        return [](const float *, unsigned long) {};
+    }
+}
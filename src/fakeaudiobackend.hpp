@@ -0,0 +1,78 @@
+#pragma once
+
+#include "audiobackend.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace deepness
+{
+    /*! A backend without hardware. Input comes from a generator, output goes to a sink, and
+     *  the callback is driven from a thread either at the simulated period or as fast as
+     *  possible. Used for headless runs and benchmarks. */
+    class FakeAudioBackend: public AudioBackend
+    {
+    public:
+        using Generator = std::function<void (float *buffer, unsigned long samples)>;
+        using Sink = std::function<void (const float *buffer, unsigned long samples)>;
+
+        struct Stats
+        {
+            unsigned long callbacks = 0;
+            unsigned long samples = 0;
+            /*! time from start to the end of the last callback */
+            double wallSeconds = 0.;
+            /*! time spent inside the callback only */
+            double callbackSeconds = 0.;
+            double maxCallbackSeconds = 0.;
+            double callbackStdDevSeconds = 0.;
+            /*! only in realtime mode: how late the callback was woken up */
+            double maxLatenessSeconds = 0.;
+            /*! callbacks that took longer than one buffer period */
+            unsigned long deadlineMisses = 0;
+            double sampleRate = 0.;
+            /*! how many times faster than realtime the callback ran */
+            double realtimeFactor() const;
+        };
+
+        /*! \param realtime  call the callback once per buffer period instead of as fast as possible
+         *  \param lengthSamples  stop by itself after this many samples, 0 runs until stop() */
+        FakeAudioBackend(Generator input,
+                         Sink output,
+                         double sampleRate,
+                         unsigned long bufferSamples = 64,
+                         bool realtime = false,
+                         unsigned long lengthSamples = 0);
+        ~FakeAudioBackend();
+        FakeAudioBackend(FakeAudioBackend const&) =delete;
+        FakeAudioBackend & operator=(FakeAudioBackend const&) =delete;
+        void start(CallbackFunc callback) override;
+        void stop() override;
+        double getSampleRate() const override;
+        /*! Blocks until lengthSamples have been processed or stop() was called. */
+        void wait();
+        /*! Only valid after wait() or stop() */
+        Stats const& getStats() const;
+
+        /*! Loops a mono sound file. */
+        static Generator fileInput(std::string const& filename);
+        static Generator sineInput(double frequency, double sampleRate, float amplitude = 0.5f);
+        static Generator silentInput();
+        /*! Writes the output to a sound file. */
+        static Sink fileOutput(std::string const& filename, double sampleRate);
+        static Sink discardOutput();
+    private:
+        void run();
+
+        Generator m_input;
+        Sink m_output;
+        double m_sampleRate;
+        unsigned long m_bufferSamples;
+        bool m_realtime;
+        unsigned long m_lengthSamples;
+        CallbackFunc m_callback;
+        std::atomic<bool> m_running;
+        std::thread m_thread;
+        Stats m_stats;
+    };
+}
@@ -0,0 +1,422 @@
+#include "looper.hpp"
+#include "soundwriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace deepness
+{
+    namespace
+    {
+        constexpr std::size_t s_commandQueueSize = 64;
+        constexpr std::size_t s_exportChunkSamples = 65536;
+    }
+
+    Looper::Looper(double sampleRate, Settings settings)
+        : m_sampleRate(sampleRate)
+        , m_maxSamples(static_cast<std::uint64_t>(settings.maxSeconds * sampleRate))
+        , m_maxLayers(std::max(1u, settings.maxLayers))
+        , m_arena(m_maxSamples * m_maxLayers, settings.backingFile)
+        , m_layerInfo(m_maxLayers, Layer{0, 0})
+        , m_state(State::Empty)
+        , m_layers(0)
+        , m_redoLayers(0)
+        , m_length(0)
+        , m_position(0)
+        , m_time(0)
+        , m_commands(s_commandQueueSize)
+        , m_publishedState(State::Empty)
+        , m_publishedLayers(0)
+        , m_publishedLength(0)
+        , m_publishedPosition(0)
+        , m_publishedTime(0)
+        , m_loopStart(0)
+        , m_quantum(0)
+        , m_exportSnapshot(m_maxLayers, Layer{0, 0})
+        , m_exportLength(0)
+        , m_exportLayers(0)
+        , m_exportPending(false)
+        , m_exportBusy(false)
+        , m_exportRunning(true)
+    {
+        m_exportThread = std::thread([this] {
+                exportThread();
+            });
+    }
+
+    Looper::~Looper()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_exportMutex);
+            m_exportRunning = false;
+        }
+        m_exportCondition.notify_one();
+        m_exportThread.join();
+    }
+
+    void Looper::operator()(const float *in, float *out, unsigned long samples)
+    {
+        unsigned long done = 0;
+        while(done < samples)
+        {
+            auto segment = samples - done;
+            if(auto *command = m_commands.front())
+            {
+                if(command->at <= m_time)
+                {
+                    apply(command->action);
+                    m_commands.pop();
+                    continue;
+                }
+                segment = static_cast<unsigned long>(std::min<std::uint64_t>(segment, command->at - m_time));
+            }
+            process(in + done, out + done, segment);
+            done += segment;
+            m_time += segment;
+        }
+        m_publishedState.store(m_state, std::memory_order_relaxed);
+        m_publishedLayers.store(m_layers, std::memory_order_relaxed);
+        m_publishedLength.store(m_length, std::memory_order_relaxed);
+        m_publishedPosition.store(m_position, std::memory_order_relaxed);
+        m_publishedTime.store(m_time, std::memory_order_release);
+    }
+
+    void Looper::process(const float *in, float *out, unsigned long samples)
+    {
+        switch(m_state)
+        {
+        case State::Empty:
+        case State::Stopped:
+            std::copy_n(in, samples, out);
+            break;
+        case State::Recording:
+        {
+            auto count = static_cast<unsigned long>(std::min<std::uint64_t>(samples, m_maxSamples - m_length));
+            std::copy_n(in, count, layerData(0) + m_length);
+            std::copy_n(in, samples, out);
+            m_length += count;
+            if(m_length == m_maxSamples)
+            {
+                // out of space, loop what we have and play the rest of the block from it
+                finishRecording();
+                process(in + count, out + count, samples - count);
+            }
+            break;
+        }
+        case State::Playing:
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                out[i] = in[i] + playback(m_position);
+                m_position = m_position + 1 == m_length ? 0 : m_position + 1;
+            }
+            break;
+        case State::Overdubbing:
+        {
+            auto &layer = m_layerInfo[m_layers];
+            auto *data = layerData(m_layers);
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                out[i] = in[i] + playback(m_position);
+                // the first pass overwrites whatever an undone layer left behind
+                if(layer.written < m_length)
+                {
+                    data[m_position] = in[i];
+                    ++layer.written;
+                }
+                else
+                {
+                    data[m_position] += in[i];
+                }
+                m_position = m_position + 1 == m_length ? 0 : m_position + 1;
+            }
+            break;
+        }
+        }
+    }
+
+    float Looper::playback(std::uint64_t position) const
+    {
+        auto sum = 0.f;
+        // an overdub is heard on its second pass already
+        auto layers = m_state == State::Overdubbing ? m_layers + 1 : m_layers;
+        for(auto i = 0u; i < layers; ++i)
+        {
+            auto const& layer = m_layerInfo[i];
+            if(layer.written >= m_length || (position + m_length - layer.offset) % m_length < layer.written)
+                sum += layerData(i)[position];
+        }
+        return sum;
+    }
+
+    float *Looper::layerData(unsigned int layer)
+    {
+        return m_arena.data() + layer * m_maxSamples;
+    }
+
+    const float *Looper::layerData(unsigned int layer) const
+    {
+        return m_arena.data() + layer * m_maxSamples;
+    }
+
+    void Looper::apply(Action action)
+    {
+        switch(action)
+        {
+        case Action::Record:
+            if(m_state == State::Recording)
+                finishRecording();
+            else if(m_exportLayers.load(std::memory_order_acquire) == 0)
+                startRecording();
+            break;
+        case Action::Overdub:
+            if(m_state == State::Recording)
+            {
+                finishRecording();
+                startOverdub();
+            }
+            else if(m_state == State::Overdubbing)
+            {
+                finishOverdub();
+            }
+            else if(m_state == State::Playing)
+            {
+                startOverdub();
+            }
+            break;
+        case Action::Play:
+            if(m_state == State::Recording)
+                finishRecording();
+            else if(m_state == State::Overdubbing)
+                finishOverdub();
+            else if(m_state == State::Stopped)
+            {
+                m_position = 0;
+                m_loopStart.store(m_time, std::memory_order_relaxed);
+                m_state = State::Playing;
+            }
+            break;
+        case Action::Stop:
+            if(m_state == State::Recording)
+                finishRecording();
+            else if(m_state == State::Overdubbing)
+                finishOverdub();
+            if(m_state == State::Playing)
+                m_state = State::Stopped;
+            break;
+        case Action::Undo:
+            if(m_state == State::Recording)
+            {
+                m_state = State::Empty;
+                m_length = 0;
+            }
+            else if(m_state == State::Overdubbing)
+            {
+                m_state = State::Playing;
+            }
+            else if(m_layers > 1)
+            {
+                --m_layers;
+            }
+            break;
+        case Action::Redo:
+            if((m_state == State::Playing || m_state == State::Stopped) && m_layers < m_redoLayers)
+                ++m_layers;
+            break;
+        case Action::Clear:
+            m_state = State::Empty;
+            m_layers = 0;
+            m_redoLayers = 0;
+            m_length = 0;
+            m_position = 0;
+            break;
+        case Action::Export:
+            snapshotExport();
+            break;
+        }
+    }
+
+    void Looper::startRecording()
+    {
+        m_state = State::Recording;
+        m_layers = 0;
+        m_redoLayers = 0;
+        m_length = 0;
+        m_position = 0;
+        m_loopStart.store(m_time, std::memory_order_relaxed);
+    }
+
+    void Looper::finishRecording()
+    {
+        if(m_length == 0)
+        {
+            m_state = State::Empty;
+            return;
+        }
+        m_layerInfo[0] = Layer{0, m_length};
+        m_layers = 1;
+        m_redoLayers = 1;
+        m_position = 0;
+        m_loopStart.store(m_time, std::memory_order_relaxed);
+        m_state = State::Playing;
+    }
+
+    void Looper::startOverdub()
+    {
+        if(m_layers >= m_maxLayers || m_layers < m_exportLayers.load(std::memory_order_acquire))
+            return;
+        m_layerInfo[m_layers] = Layer{m_position, 0};
+        m_redoLayers = m_layers;
+        m_state = State::Overdubbing;
+    }
+
+    void Looper::finishOverdub()
+    {
+        ++m_layers;
+        m_redoLayers = m_layers;
+        m_state = State::Playing;
+    }
+
+    void Looper::snapshotExport()
+    {
+        m_exportLength = m_length;
+        auto layers = m_state == State::Recording ? 0u : m_layers;
+        std::copy_n(m_layerInfo.begin(), layers, m_exportSnapshot.begin());
+        m_exportLayers.store(layers, std::memory_order_release);
+        m_exportPending.store(true, std::memory_order_release);
+    }
+
+    bool Looper::post(Action action, std::uint64_t at, bool quantize)
+    {
+        auto quantum = m_quantum.load(std::memory_order_relaxed);
+        if(quantize && quantum)
+        {
+            auto anchor = m_loopStart.load(std::memory_order_relaxed);
+            at = std::max(at, m_publishedTime.load(std::memory_order_acquire));
+            if(at > anchor)
+                at = anchor + (at - anchor + quantum - 1) / quantum * quantum;
+        }
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        return m_commands.push(Command{action, at});
+    }
+
+    void Looper::setQuantum(std::uint64_t samples)
+    {
+        m_quantum = samples;
+    }
+
+    bool Looper::exportLoop(std::string filename)
+    {
+        if(m_exportBusy.exchange(true))
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(m_exportMutex);
+            m_exportFilename = std::move(filename);
+        }
+        if(!post(Action::Export))
+        {
+            m_exportBusy = false;
+            return false;
+        }
+        return true;
+    }
+
+    Looper::Status Looper::getStatus() const
+    {
+        Status status;
+        status.time = m_publishedTime.load(std::memory_order_acquire);
+        status.state = m_publishedState.load(std::memory_order_relaxed);
+        status.layers = m_publishedLayers.load(std::memory_order_relaxed);
+        status.length = m_publishedLength.load(std::memory_order_relaxed);
+        status.position = m_publishedPosition.load(std::memory_order_relaxed);
+        status.exporting = m_exportBusy.load(std::memory_order_relaxed);
+        return status;
+    }
+
+    void Looper::exportThread()
+    {
+        std::vector<float> chunk(s_exportChunkSamples);
+        std::unique_lock<std::mutex> lock(m_exportMutex);
+        while(m_exportRunning)
+        {
+            // the audio thread can't notify, so poll for its snapshot
+            m_exportCondition.wait_for(lock, std::chrono::milliseconds(20));
+            if(!m_exportPending.load(std::memory_order_acquire))
+                continue;
+            auto filename = m_exportFilename;
+            lock.unlock();
+            auto layers = m_exportLayers.load(std::memory_order_acquire);
+            try
+            {
+                if(layers == 0 || m_exportLength == 0)
+                    throw SoundWriter::Exception("nothing recorded");
+                SoundWriter writer(filename, m_sampleRate);
+                for(std::uint64_t start = 0; start < m_exportLength; start += chunk.size())
+                {
+                    auto count = std::min<std::uint64_t>(chunk.size(), m_exportLength - start);
+                    std::fill_n(chunk.begin(), count, 0.f);
+                    for(auto l = 0u; l < layers; ++l)
+                    {
+                        auto const& layer = m_exportSnapshot[l];
+                        auto const *data = layerData(l) + start;
+                        for(std::uint64_t i = 0; i < count; ++i)
+                        {
+                            auto position = start + i;
+                            if(layer.written >= m_exportLength || (position + m_exportLength - layer.offset) % m_exportLength < layer.written)
+                                chunk[i] += data[i];
+                        }
+                    }
+                    writer.write(chunk.data(), count);
+                }
+                std::cerr << "Exported loop to " << filename << std::endl;
+            }
+            catch(SoundWriter::Exception const& e)
+            {
+                std::cerr << "Error exporting loop to " << filename << ": " << e.what() << std::endl;
+            }
+            m_exportLayers.store(0, std::memory_order_release);
+            m_exportPending.store(false, std::memory_order_release);
+            m_exportBusy.store(false, std::memory_order_release);
+            lock.lock();
+        }
+    }
+
+    const char *Looper::toString(State state)
+    {
+        switch(state)
+        {
+        case State::Empty:
+            return "empty";
+        case State::Recording:
+            return "recording";
+        case State::Playing:
+            return "playing";
+        case State::Overdubbing:
+            return "overdubbing";
+        case State::Stopped:
+            return "stopped";
+        }
+        return "";
+    }
+
+    bool Looper::fromString(std::string const& name, Action &action)
+    {
+        static const std::pair<const char *, Action> actions[] = {
+            {"record", Action::Record},
+            {"overdub", Action::Overdub},
+            {"play", Action::Play},
+            {"stop", Action::Stop},
+            {"undo", Action::Undo},
+            {"redo", Action::Redo},
+            {"clear", Action::Clear},
+        };
+        for(auto const& candidate: actions)
+        {
+            if(name == candidate.first)
+            {
+                action = candidate.second;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "mappedbuffer.hpp"
+#include "spscqueue.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace deepness
+{
+    /*! Records its input into a preallocated arena and plays it back mixed with the input.
+     *  Every overdub goes into its own layer so it can be undone. Commands carry the sample
+     *  time at which they take effect and are applied at exactly that sample, even inside a
+     *  block. Memory use is maxSeconds * maxLayers samples, allocated in the constructor. */
+    class Looper
+    {
+    public:
+        enum class State
+        {
+            Empty,
+            Recording,
+            Playing,
+            Overdubbing,
+            Stopped,
+        };
+        enum class Action
+        {
+            Record,
+            Overdub,
+            Play,
+            Stop,
+            Undo,
+            Redo,
+            Clear,
+            Export,
+        };
+        struct Settings
+        {
+            double maxSeconds = 120.;
+            unsigned int maxLayers = 8;
+            /*! back the arena with this file instead of anonymous memory */
+            std::string backingFile;
+        };
+        struct Status
+        {
+            State state;
+            unsigned int layers;
+            std::uint64_t length;
+            std::uint64_t position;
+            std::uint64_t time;
+            bool exporting;
+        };
+
+        Looper(double sampleRate, Settings settings);
+        ~Looper();
+        Looper(Looper const&) = delete;
+        Looper &operator=(Looper const&) = delete;
+        /*! Audio thread. */
+        void operator()(const float *in, float *out, unsigned long samples);
+
+        /*! Schedules \a action at sample time \a at, or at the start of the next block if that
+         *  has already passed. Commands are applied in the order they were posted.
+         *  \param quantize  round \a at up to the quantum grid, which starts at the loop start
+         *  \returns false if the command queue is full */
+        bool post(Action action, std::uint64_t at = 0, bool quantize = false);
+        /*! Grid for quantized commands in samples, 0 to disable quantizing. */
+        void setQuantum(std::uint64_t samples);
+        /*! Writes the loop to \a filename from a background thread. While the export runs,
+         *  recording into the exported layers is refused.
+         *  \returns false if an export is already running */
+        bool exportLoop(std::string filename);
+        Status getStatus() const;
+
+        static const char *toString(State state);
+        /*! \returns false for unknown names */
+        static bool fromString(std::string const& name, Action &action);
+    private:
+        struct Command
+        {
+            Action action;
+            std::uint64_t at;
+        };
+        struct Layer
+        {
+            /*! loop position the layer starts at */
+            std::uint64_t offset;
+            /*! samples written, the layer covers the whole loop once this reaches the length */
+            std::uint64_t written;
+        };
+
+        void apply(Action action);
+        void process(const float *in, float *out, unsigned long samples);
+        float playback(std::uint64_t position) const;
+        float *layerData(unsigned int layer);
+        const float *layerData(unsigned int layer) const;
+        void startRecording();
+        void finishRecording();
+        void startOverdub();
+        void finishOverdub();
+        void snapshotExport();
+        void exportThread();
+
+        double m_sampleRate;
+        std::uint64_t m_maxSamples;
+        unsigned int m_maxLayers;
+        MappedBuffer m_arena;
+        std::vector<Layer> m_layerInfo;
+
+        // audio thread state
+        State m_state;
+        unsigned int m_layers;
+        unsigned int m_redoLayers;
+        std::uint64_t m_length;
+        std::uint64_t m_position;
+        std::uint64_t m_time;
+
+        SpscQueue<Command> m_commands;
+        std::mutex m_postMutex;
+
+        // published for other threads
+        std::atomic<State> m_publishedState;
+        std::atomic<unsigned int> m_publishedLayers;
+        std::atomic<std::uint64_t> m_publishedLength;
+        std::atomic<std::uint64_t> m_publishedPosition;
+        std::atomic<std::uint64_t> m_publishedTime;
+        std::atomic<std::uint64_t> m_loopStart;
+        std::atomic<std::uint64_t> m_quantum;
+
+        // export, the snapshot is written by the audio thread before m_exportPending is set
+        std::vector<Layer> m_exportSnapshot;
+        std::uint64_t m_exportLength;
+        std::atomic<unsigned int> m_exportLayers;
+        std::atomic<bool> m_exportPending;
+        std::atomic<bool> m_exportBusy;
+        std::atomic<bool> m_exportRunning;
+        std::string m_exportFilename;
+        std::mutex m_exportMutex;
+        std::condition_variable m_exportCondition;
+        std::thread m_exportThread;
+    };
+}
@@ -0,0 +1,79 @@
+#include "mappedbuffer.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace deepness
+{
+    MappedBuffer::MappedBuffer(std::size_t samples, std::string const& filename)
+        : m_data(nullptr)
+        , m_samples(samples)
+    {
+        auto bytes = samples * sizeof(float);
+        void *data = MAP_FAILED;
+        if(filename.empty())
+        {
+            data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        }
+        else
+        {
+            auto fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0)
+                throw Exception("Error opening " + filename + ": " + std::strerror(errno));
+            if(ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+                data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+            auto err = errno;
+            close(fd);
+            errno = err;
+        }
+        if(data == MAP_FAILED)
+            throw Exception(std::string("Error mapping buffer: ") + std::strerror(errno));
+        m_data = static_cast<float *>(data);
+    }
+
+    MappedBuffer::MappedBuffer() noexcept
+        : m_data(nullptr)
+        , m_samples(0)
+    {}
+
+    MappedBuffer::MappedBuffer(MappedBuffer &&other) noexcept
+        : m_data(nullptr)
+        , m_samples(0)
+    {
+        *this = std::move(other);
+    }
+
+    MappedBuffer &MappedBuffer::operator=(MappedBuffer &&other) noexcept
+    {
+        if(m_data)
+            munmap(m_data, m_samples * sizeof(float));
+        m_data = other.m_data;
+        m_samples = other.m_samples;
+        other.m_data = nullptr;
+        other.m_samples = 0;
+        return *this;
+    }
+
+    MappedBuffer::~MappedBuffer() noexcept
+    {
+        if(m_data)
+            munmap(m_data, m_samples * sizeof(float));
+    }
+
+    float *MappedBuffer::data() noexcept
+    {
+        return m_data;
+    }
+
+    const float *MappedBuffer::data() const noexcept
+    {
+        return m_data;
+    }
+
+    std::size_t MappedBuffer::size() const noexcept
+    {
+        return m_samples;
+    }
+}
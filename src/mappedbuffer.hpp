@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <string>
+
+namespace deepness
+{
+    /*! A zeroed float buffer whose pages are all mapped up front, so touching it from the
+     *  audio thread never faults. With a filename it is backed by that file, which keeps
+     *  very long buffers out of swap. */
+    class MappedBuffer
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+
+        MappedBuffer() noexcept;
+        /*! \param filename  empty for anonymous memory */
+        MappedBuffer(std::size_t samples, std::string const& filename = std::string());
+        MappedBuffer(MappedBuffer &&other) noexcept;
+        MappedBuffer &operator=(MappedBuffer &&other) noexcept;
+        ~MappedBuffer() noexcept;
+        MappedBuffer(MappedBuffer const&) = delete;
+        MappedBuffer &operator=(MappedBuffer const&) = delete;
+        float *data() noexcept;
+        const float *data() const noexcept;
+        std::size_t size() const noexcept;
+    private:
+        float *m_data;
+        std::size_t m_samples;
+    };
+}
@@ -0,0 +1,22 @@
+#include "meters.hpp"
+
+namespace deepness
+{
+    Meters::Meter Meters::get(std::string const& name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto &meter = m_meters[name];
+        if(!meter)
+            meter = std::make_shared<std::atomic<float>>(0.f);
+        return meter;
+    }
+
+    json11::Json Meters::toJson() const
+    {
+        json11::Json::object values;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto const& meter: m_meters)
+            values[meter.first] = meter.second->load(std::memory_order_relaxed);
+        return values;
+    }
+}
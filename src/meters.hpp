@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <json11.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace deepness
+{
+    /*! Named values published by the audio thread, like gain reduction, and read by the
+     *  webserver. Meters are created while building the effect graph; the audio thread
+     *  only stores to the atomics it was handed. */
+    class Meters
+    {
+    public:
+        using Meter = std::shared_ptr<std::atomic<float>>;
+        /*! Creates the meter if it doesn't exist yet. */
+        Meter get(std::string const& name);
+        /*! \returns an object with the current value of every meter */
+        json11::Json toJson() const;
+    private:
+        mutable std::mutex m_mutex;
+        std::map<std::string, Meter> m_meters;
+    };
+}
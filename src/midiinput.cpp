@@ -0,0 +1,124 @@
+#include "midiinput.hpp"
+#include <alsa/asoundlib.h>
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <json11.hpp>
+#include <sstream>
+
+namespace deepness
+{
+    namespace
+    {
+        constexpr int s_pollMilliseconds = 100;
+    }
+
+    MidiInput::MidiInput(Controls &controls, std::vector<Mapping> mappings, std::string const& portName)
+        : m_controls(controls)
+        , m_mappings(std::move(mappings))
+        , m_seq(nullptr)
+        , m_port(-1)
+        , m_running(true)
+    {
+        auto names = m_controls.getNames();
+        for(auto const& mapping: m_mappings)
+        {
+            if(std::find(names.begin(), names.end(), mapping.control) == names.end())
+                std::cerr << "MIDI controller " << mapping.controller << " is mapped to unknown control " << mapping.control << std::endl;
+        }
+        auto err = snd_seq_open(&m_seq, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK);
+        if(err < 0)
+            throw Exception(std::string("Error opening ALSA sequencer: ") + snd_strerror(err));
+        snd_seq_set_client_name(m_seq, portName.c_str());
+        m_port = snd_seq_create_simple_port(m_seq, portName.c_str(),
+                                            SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                            SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        if(m_port < 0)
+        {
+            snd_seq_close(m_seq);
+            throw Exception(std::string("Error creating sequencer port: ") + snd_strerror(m_port));
+        }
+        m_thread = std::thread([this] {
+                run();
+            });
+    }
+
+    MidiInput::~MidiInput()
+    {
+        m_running = false;
+        m_thread.join();
+        snd_seq_close(m_seq);
+    }
+
+    std::string MidiInput::getAddress() const
+    {
+        return std::to_string(snd_seq_client_id(m_seq)) + ":" + std::to_string(m_port);
+    }
+
+    void MidiInput::run()
+    {
+        std::vector<pollfd> descriptors(snd_seq_poll_descriptors_count(m_seq, POLLIN));
+        snd_seq_poll_descriptors(m_seq, descriptors.data(), static_cast<unsigned int>(descriptors.size()), POLLIN);
+        while(m_running)
+        {
+            // a timeout rather than a wakeup pipe, stopping isn't in a hurry
+            if(poll(descriptors.data(), descriptors.size(), s_pollMilliseconds) <= 0)
+                continue;
+            while(true)
+            {
+                snd_seq_event_t *event;
+                auto err = snd_seq_event_input(m_seq, &event);
+                if(err == -ENOSPC)
+                {
+                    std::cerr << "MIDI input overrun, events lost" << std::endl;
+                    continue;
+                }
+                if(err < 0)
+                    break;
+                auto now = std::chrono::steady_clock::now();
+                if(event->type != SND_SEQ_EVENT_CONTROLLER)
+                    continue;
+                auto const& control = event->data.control;
+                for(auto const& mapping: m_mappings)
+                {
+                    if(mapping.controller != control.param || (mapping.channel >= 0 && mapping.channel != control.channel))
+                        continue;
+                    auto value = mapping.min + (mapping.max - mapping.min) * std::min(std::max(control.value, 0), 127) / 127.f;
+                    if(!m_controls.post(mapping.control, value, m_controls.timeAt(now)))
+                        std::cerr << "Control event for " << mapping.control << " dropped" << std::endl;
+                }
+            }
+        }
+    }
+
+    std::vector<MidiInput::Mapping> MidiInput::loadMappings(std::string const& filename)
+    {
+        std::ifstream file(filename);
+        if(!file)
+            throw Exception("Can't open MIDI mappings " + filename);
+        std::stringstream text;
+        text << file.rdbuf();
+        std::string error;
+        auto json = json11::Json::parse(text.str(), error);
+        if(!json.is_array())
+            throw Exception("MIDI mappings " + filename + " aren't an array " + error);
+        std::vector<Mapping> mappings;
+        for(auto const& item: json.array_items())
+        {
+            if(!item["cc"].is_number() || !item["control"].is_string())
+                throw Exception("MIDI mapping " + item.dump() + " needs a cc and a control");
+            Mapping mapping;
+            mapping.controller = static_cast<unsigned int>(item["cc"].int_value());
+            mapping.control = item["control"].string_value();
+            if(item["channel"].is_number())
+                mapping.channel = item["channel"].int_value();
+            if(item["min"].is_number())
+                mapping.min = static_cast<float>(item["min"].number_value());
+            if(item["max"].is_number())
+                mapping.max = static_cast<float>(item["max"].number_value());
+            mappings.push_back(std::move(mapping));
+        }
+        return mappings;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "controls.hpp"
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct _snd_seq snd_seq_t;
+
+namespace deepness
+{
+    /*! A virtual ALSA sequencer port that turns MIDI control changes into control events.
+     *  It needs no hardware: footswitches, keyboards or sequencers are connected to it with
+     *  aconnect or a patchbay. Every event is stamped when it is read and scheduled through
+     *  Controls::timeAt(), so the delay is the same for all of them and a burst keeps its
+     *  timing. */
+    class MidiInput
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+        struct Mapping
+        {
+            /*! -1 for any channel */
+            int channel = -1;
+            unsigned int controller = 0;
+            std::string control;
+            /*! control values for controller values 0 and 127 */
+            float min = 0.f;
+            float max = 1.f;
+        };
+
+        MidiInput(Controls &controls, std::vector<Mapping> mappings, std::string const& portName = "pedal");
+        ~MidiInput();
+        MidiInput(MidiInput const&) = delete;
+        MidiInput &operator=(MidiInput const&) = delete;
+        /*! "client:port" to connect to */
+        std::string getAddress() const;
+
+        /*! Reads a JSON array of {"cc", "control", "channel", "min", "max"}. */
+        static std::vector<Mapping> loadMappings(std::string const& filename);
+    private:
+        void run();
+
+        Controls &m_controls;
+        std::vector<Mapping> m_mappings;
+        snd_seq_t *m_seq;
+        int m_port;
+        std::atomic<bool> m_running;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace deepness
+{
+    /*! Bounded lock-free queue for any number of producer threads and one consumer thread.
+     *  Every slot carries a sequence number, so producers claim slots with a single
+     *  compare-and-swap and the consumer never waits. Everything is allocated up front, so
+     *  both ends are safe to use on the audio thread. An item claimed but not yet written
+     *  holds back the ones behind it until its producer is done. */
+    template<typename T>
+    class MpscQueue
+    {
+    public:
+        /*! \param capacity  rounded up to a power of two */
+        explicit MpscQueue(std::size_t capacity)
+            : m_size(roundUp(capacity))
+            , m_mask(m_size - 1)
+            , m_cells(new Cell[m_size])
+            , m_head(0)
+            , m_tail(0)
+        {
+            for(std::size_t i = 0; i < m_size; ++i)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        MpscQueue(MpscQueue const&) = delete;
+        MpscQueue &operator=(MpscQueue const&) = delete;
+
+        /*! \returns false if the queue is full */
+        bool push(T const& item)
+        {
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            while(true)
+            {
+                auto &cell = m_cells[tail & m_mask];
+                auto sequence = cell.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(tail);
+                if(difference == 0)
+                {
+                    if(m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                    {
+                        cell.item = item;
+                        cell.sequence.store(tail + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    tail = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /*! Consumer. \returns the oldest item, or nullptr if the queue is empty. Only valid until pop() */
+        T *front()
+        {
+            auto &cell = m_cells[m_head & m_mask];
+            if(cell.sequence.load(std::memory_order_acquire) != m_head + 1)
+                return nullptr;
+            return &cell.item;
+        }
+
+        /*! Consumer. */
+        void pop()
+        {
+            m_cells[m_head & m_mask].sequence.store(m_head + m_size, std::memory_order_release);
+            ++m_head;
+        }
+
+        std::size_t capacity() const
+        {
+            return m_size;
+        }
+    private:
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            T item;
+        };
+
+        static std::size_t roundUp(std::size_t capacity)
+        {
+            std::size_t size = 1;
+            while(size < capacity)
+                size *= 2;
+            return size;
+        }
+
+        std::size_t m_size;
+        std::size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+        // consumer only
+        std::size_t m_head;
+        alignas(64) std::atomic<std::size_t> m_tail;
+    };
+}
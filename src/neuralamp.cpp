@@ -0,0 +1,234 @@
+#include "neuralamp.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+namespace deepness
+{
+    namespace
+    {
+        using Json = json11::Json;
+
+        /*! Padé approximant, within 1e-4 of tanh and cheap enough to vectorize. */
+        inline float fastTanh(float x)
+        {
+            x = std::min(std::max(x, -5.f), 5.f);
+            auto x2 = x * x;
+            auto result = x * (135135.f + x2 * (17325.f + x2 * (378.f + x2)))
+                / (135135.f + x2 * (62370.f + x2 * (3150.f + 28.f * x2)));
+            return std::min(std::max(result, -1.f), 1.f);
+        }
+
+        inline float fastSigmoid(float x)
+        {
+            return 0.5f + 0.5f * fastTanh(0.5f * x);
+        }
+
+        /*! The weights as read from the file, row major like PyTorch. */
+        struct Weights
+        {
+            unsigned int hidden;
+            bool skip;
+            std::vector<float> input;
+            std::vector<float> recurrent;
+            std::vector<float> bias;
+            std::vector<float> output;
+            float outputBias;
+        };
+
+        /*! Flattens a tensor, checking that it has \a rows x \a columns elements. */
+        std::vector<float> tensor(Json const& json, std::string const& name, std::size_t rows, std::size_t columns)
+        {
+            std::vector<float> result;
+            auto const& value = json[name];
+            for(auto const& row: value.array_items())
+            {
+                if(row.is_array())
+                {
+                    if(row.array_items().size() != columns)
+                        throw NeuralAmp::Exception(name + " has rows of the wrong size");
+                    for(auto const& item: row.array_items())
+                        result.push_back(static_cast<float>(item.number_value()));
+                }
+                else
+                    result.push_back(static_cast<float>(row.number_value()));
+            }
+            if(result.size() != rows * columns)
+                throw NeuralAmp::Exception(name + " should have " + std::to_string(rows * columns) + " weights, has " + std::to_string(result.size()));
+            return result;
+        }
+
+        template<unsigned int Hidden>
+        class Lstm: public NeuralAmp::Model
+        {
+        public:
+            static constexpr unsigned int s_gates = 4 * Hidden;
+
+            // over-aligned types aren't honoured by new before C++17
+            static void *operator new(std::size_t size)
+            {
+                void *p;
+                if(posix_memalign(&p, 64, size))
+                    throw std::bad_alloc();
+                return p;
+            }
+
+            static void operator delete(void *p)
+            {
+                std::free(p);
+            }
+
+            explicit Lstm(Weights const& weights)
+                : m_outputBias(weights.outputBias)
+                , m_skip(weights.skip)
+            {
+                // column major, so the product is a sum of scaled columns over contiguous gates
+                for(unsigned int row = 0; row < s_gates; ++row)
+                {
+                    for(unsigned int column = 0; column < Hidden; ++column)
+                        m_recurrent[column * s_gates + row] = weights.recurrent[row * Hidden + column];
+                }
+                std::copy_n(weights.input.begin(), s_gates, m_input);
+                std::copy_n(weights.bias.begin(), s_gates, m_bias);
+                std::copy_n(weights.output.begin(), Hidden, m_output);
+                std::fill_n(m_hidden, Hidden, 0.f);
+                std::fill_n(m_cell, Hidden, 0.f);
+            }
+
+            void process(const float *in, float *out, unsigned long samples) override
+            {
+                for(decltype(samples) i = 0; i < samples; ++i)
+                {
+                    auto x = in[i];
+                    for(unsigned int gate = 0; gate < s_gates; ++gate)
+                        m_gates[gate] = m_bias[gate] + m_input[gate] * x;
+                    for(unsigned int column = 0; column < Hidden; ++column)
+                    {
+                        auto h = m_hidden[column];
+                        const float *weights = m_recurrent + column * s_gates;
+                        for(unsigned int gate = 0; gate < s_gates; ++gate)
+                            m_gates[gate] += weights[gate] * h;
+                    }
+                    // PyTorch gate order: input, forget, cell, output
+                    for(unsigned int unit = 0; unit < Hidden; ++unit)
+                    {
+                        auto inputGate = fastSigmoid(m_gates[unit]);
+                        auto forgetGate = fastSigmoid(m_gates[Hidden + unit]);
+                        auto cellGate = fastTanh(m_gates[2 * Hidden + unit]);
+                        auto outputGate = fastSigmoid(m_gates[3 * Hidden + unit]);
+                        m_cell[unit] = forgetGate * m_cell[unit] + inputGate * cellGate;
+                        m_hidden[unit] = outputGate * fastTanh(m_cell[unit]);
+                    }
+                    // separate from the activations, whose loop vectorizes without the sum
+                    auto y = m_outputBias;
+                    for(unsigned int unit = 0; unit < Hidden; ++unit)
+                        y += m_output[unit] * m_hidden[unit];
+                    out[i] = m_skip ? y + x : y;
+                }
+            }
+        private:
+            alignas(64) float m_recurrent[s_gates * Hidden];
+            alignas(64) float m_input[s_gates];
+            alignas(64) float m_bias[s_gates];
+            alignas(64) float m_gates[s_gates];
+            alignas(64) float m_output[Hidden];
+            alignas(64) float m_hidden[Hidden];
+            alignas(64) float m_cell[Hidden];
+            float m_outputBias;
+            bool m_skip;
+        };
+
+        template<unsigned int Hidden>
+        std::shared_ptr<NeuralAmp::Model> makeLstm(Weights const& weights)
+        {
+            return std::shared_ptr<NeuralAmp::Model>(new Lstm<Hidden>(weights));
+        }
+    }
+
+    NeuralAmp::NeuralAmp(Json const& model)
+    {
+        auto const& data = model["model_data"];
+        auto const& state = model["state_dict"];
+        if(!data.is_object() || !state.is_object())
+            throw Exception("Not a model file, model_data or state_dict missing");
+        auto const& unit = data["unit_type"].string_value();
+        if(unit != "LSTM")
+            throw Exception("Unsupported unit type " + unit + ", only LSTM is");
+        if(data["num_layers"].is_number() && data["num_layers"].int_value() != 1)
+            throw Exception("Only single layer models are supported");
+        if(data["input_size"].is_number() && data["input_size"].int_value() != 1)
+            throw Exception("Only mono input models are supported");
+        Weights weights;
+        weights.hidden = static_cast<unsigned int>(data["hidden_size"].int_value());
+        weights.skip = data["skip"].is_bool() ? data["skip"].bool_value() : data["skip"].int_value() != 0;
+        auto hidden = weights.hidden;
+        weights.input = tensor(state, "rec.weight_ih_l0", 4 * hidden, 1);
+        weights.recurrent = tensor(state, "rec.weight_hh_l0", 4 * hidden, hidden);
+        weights.bias = tensor(state, "rec.bias_ih_l0", 4 * hidden, 1);
+        auto recurrentBias = tensor(state, "rec.bias_hh_l0", 4 * hidden, 1);
+        for(std::size_t i = 0; i < weights.bias.size(); ++i)
+            weights.bias[i] += recurrentBias[i];
+        weights.output = tensor(state, "lin.weight", 1, hidden);
+        weights.outputBias = tensor(state, "lin.bias", 1, 1).front();
+        switch(hidden)
+        {
+        case 8:
+            m_model = makeLstm<8>(weights);
+            break;
+        case 12:
+            m_model = makeLstm<12>(weights);
+            break;
+        case 16:
+            m_model = makeLstm<16>(weights);
+            break;
+        case 20:
+            m_model = makeLstm<20>(weights);
+            break;
+        case 24:
+            m_model = makeLstm<24>(weights);
+            break;
+        case 32:
+            m_model = makeLstm<32>(weights);
+            break;
+        case 40:
+            m_model = makeLstm<40>(weights);
+            break;
+        case 48:
+            m_model = makeLstm<48>(weights);
+            break;
+        case 64:
+            m_model = makeLstm<64>(weights);
+            break;
+        default:
+            throw Exception("Unsupported hidden size " + std::to_string(hidden));
+        }
+        m_hiddenSize = hidden;
+    }
+
+    NeuralAmp NeuralAmp::load(std::string const& filename)
+    {
+        std::ifstream file(filename);
+        if(!file)
+            throw Exception("Can't open model " + filename);
+        std::stringstream text;
+        text << file.rdbuf();
+        std::string error;
+        auto json = Json::parse(text.str(), error);
+        if(!error.empty())
+            throw Exception("Error parsing model " + filename + ": " + error);
+        return NeuralAmp(json);
+    }
+
+    void NeuralAmp::operator()(const float *in, float *out, unsigned long samples)
+    {
+        m_model->process(in, out, samples);
+    }
+
+    unsigned int NeuralAmp::getHiddenSize() const
+    {
+        return m_hiddenSize;
+    }
+}
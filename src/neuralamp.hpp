@@ -0,0 +1,50 @@
+#pragma once
+
+#include <exception>
+#include <json11.hpp>
+#include <memory>
+#include <string>
+
+namespace deepness
+{
+    /*! Runs a captured amp model: a single layer LSTM followed by a dense output, optionally
+     *  added to the input, as trained and exported by Automated-GuitarAmpModelling. The file
+     *  has "model_data" with "unit_type": "LSTM", "hidden_size" and "skip", and "state_dict"
+     *  with rec.weight_ih_l0, rec.weight_hh_l0, rec.bias_ih_l0, rec.bias_hh_l0, lin.weight
+     *  and lin.bias.
+     *
+     *  The network is instantiated for its hidden size at compile time, 8 to 64 units, with
+     *  the weights in one aligned block laid out for the recurrent matrix-vector product. All
+     *  state lives in that block, so processing never allocates. */
+    class NeuralAmp
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+        class Model
+        {
+        public:
+            virtual ~Model() = default;
+            virtual void process(const float *in, float *out, unsigned long samples) = 0;
+        };
+
+        explicit NeuralAmp(json11::Json const& model);
+        static NeuralAmp load(std::string const& filename);
+        void operator()(const float *in, float *out, unsigned long samples);
+        unsigned int getHiddenSize() const;
+    private:
+        std::shared_ptr<Model> m_model;
+        unsigned int m_hiddenSize;
+    };
+}
@@ -7,12 +7,39 @@
 #include <iomanip>
 #include <unistd.h>
 #include "webserver.hpp"
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include "soundloop.hpp"
+#include "looper.hpp"
+#include "batchrenderer.hpp"
+#include "preset.hpp"
+#include "controls.hpp"
+#include "meters.hpp"
+#include "reblocker.hpp"
+#include "sessionrecorder.hpp"
+#include "soundwriter.hpp"
+#include "fakeaudiobackend.hpp"
+#include "portaudiobackend.hpp"
+#ifdef PEDAL_HAVE_ALSA
+#include "alsabackend.hpp"
+#include "midiinput.hpp"
+#endif
 
 using namespace deepness;
 using namespace std;
 
+/*! \a name in \a directory, which is created if needed, or an empty string unless \a name
+ *  is a bare file name. Websocket clients aren't trusted to write anywhere else. */
+std::string fileInDirectory(std::string const& directory, std::string const& name)
+{
+    if(name.empty() || name.find('/') != std::string::npos || name.find("..") != std::string::npos || name.find('\0') != std::string::npos)
+        return std::string();
+    boost::system::error_code error;
+    // opening the file reports a failure
+    boost::filesystem::create_directories(directory, error);
+    return (boost::filesystem::path(directory) / name).string();
+}
+
 float average(const float *in, unsigned long samples)
 {
     auto average = 0.f;
@@ -77,7 +104,32 @@ int main(int argc, char *argv[])
     po::options_description desc("Options");
     desc.add_options()
         ("help", "help")
-        ("override-input", po::value<std::string>(), "A wavefile to use instead of microphone input");
+        ("watch-http-root", "reload the web interface files when they change")
+        ("http-threads", po::value<unsigned int>()->default_value(2), "threads serving websocket and http connections")
+        ("handler-threads", po::value<unsigned int>()->default_value(2), "threads running slow websocket command handlers")
+        ("preset", po::value<std::string>()->default_value("presets/default.json"), "effect graph to run")
+        ("preset-cache", po::value<std::string>()->default_value(Preset::defaultCacheDirectory()), "directory for compiled presets, empty to disable")
+        ("override-input", po::value<std::string>(), "A wavefile to use instead of microphone input")
+        ("backend", po::value<std::string>()->default_value("portaudio"), "portaudio, alsa or fake")
+        ("buffer-size", po::value<unsigned long>()->default_value(64), "frames per callback")
+        ("quantum", po::value<unsigned long>()->default_value(64), "process in blocks of exactly 32, 64 or 128 samples whatever the callback size, 0 to process callbacks as they come")
+        ("alsa-device", po::value<std::string>()->default_value("hw:0"), "alsa backend: device to open")
+        ("alsa-periods", po::value<unsigned int>()->default_value(2), "alsa backend: periods in the hardware buffer")
+        ("realtime-priority", po::value<int>()->default_value(80), "alsa backend: SCHED_FIFO priority of the audio thread")
+        ("cpu", po::value<int>()->default_value(-1), "alsa backend: cpu to pin the audio thread to, -1 for any")
+        ("fake-input", po::value<std::string>(), "fake backend: wavefile to loop as input, silence if not given")
+        ("fake-output", po::value<std::string>(), "fake backend: wavefile to record the output to")
+        ("fake-duration", po::value<double>()->default_value(10.), "fake backend: seconds of audio to process")
+        ("fake-realtime", "fake backend: call back once per buffer period instead of as fast as possible")
+        ("looper-seconds", po::value<double>()->default_value(60.), "longest loop the looper can record")
+        ("looper-layers", po::value<unsigned int>()->default_value(4), "overdub layers of the looper, including the first recording")
+        ("looper-file", po::value<std::string>(), "back the looper memory with this file, for long takes")
+        ("record", po::value<std::string>(), "record the dry input and wet output to this wav or flac file from the start")
+        ("recordings", po::value<std::string>()->default_value("recordings"), "directory the websocket recorder and looper export write their files to")
+        ("midi-map", po::value<std::string>(), "open an ALSA sequencer MIDI port and map controllers to controls as listed in this JSON file")
+        ("batch", po::value<std::vector<std::string>>()->multitoken(), "render these files or directories instead of running live")
+        ("batch-output", po::value<std::string>()->default_value("rendered"), "batch: directory to write the rendered files to")
+        ("jobs", po::value<unsigned int>()->default_value(0), "batch: worker threads, 0 for one per core");
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
     po::notify(vm);
@@ -86,29 +138,57 @@ int main(int argc, char *argv[])
         std::cout << desc << std::endl;
         return 1;
     }
+    std::unique_ptr<Preset> preset;
+    try
+    {
+        preset = std::make_unique<Preset>(vm["preset"].as<std::string>(), vm["preset-cache"].as<std::string>());
+    }
+    catch(Preset::Exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    auto makeEffects = [&preset](double sampleRate) -> SoundTransform {
+        return preset->instantiate(sampleRate);
+    };
+    if(vm.count("batch"))
+    {
+        auto jobs = BatchRenderer::collect(vm["batch"].as<std::vector<std::string>>(), vm["batch-output"].as<std::string>());
+        BatchRenderer renderer(makeEffects, vm["jobs"].as<unsigned int>(), vm["buffer-size"].as<unsigned long>());
+        auto result = renderer.render(jobs);
+        std::cout << "files: " << result.files << " (" << result.failures << " failed)\n"
+                  << "audio: " << result.audioSeconds << " s in " << result.wallSeconds << " s\n"
+                  << "throughput: " << result.samples / result.wallSeconds << " samples/s, "
+                  << result.audioSeconds / result.wallSeconds << "x realtime" << std::endl;
+        return result.failures ? 2 : 0;
+    }
     std::vector<std::function<void (const float *, float *, unsigned long)>> transforms;
     if(vm.count("override-input"))
         transforms.push_back(SoundLoopTransform{SoundLoop{vm["override-input"].as<std::string>()}});
     double sampleRate = 44100;
-    //auto effect = &passthrough;
-    //auto effect = &fuzz;
-    //auto effect = Delay(sampleRate);
-    //auto effect = combine(Delay(sampleRate), &fuzz, &passthrough);
-    //auto drone = Drone{sampleRate};
-    //auto effect = combine(drone, Compress(5.f), &clip);
-    //transforms.push_back(WetDryMix(OctaveDown(), Mixer(0.5f)));
-    //transforms.push_back(WetDryMix(OctaveUp(), Mixer(0.5f)));
-    //transforms.push_back(WetDryMix(chain({AbsOctaveUp(), HiPass(sampleRate, 1000.f), AbsOctaveUp(), HiPass(sampleRate, 1000.f)}), Mixer(.5f)));
-    transforms.push_back(WetDryMix(chain({
-                    HiPass(sampleRate, 10.f)
-                        , LoPass(sampleRate, 100.f)
-                        , SquareOctaveDown(1)
-                        , HiPass(sampleRate, 1000.f)
-                        }), Mixer(0.1f)));
-    auto effect = combine(Compress(1.5f), &clip);
-    //transforms.push_back(iterate(effect));
-    //transforms.push_back(WetDryMix(chain({iterate(Drone{sampleRate}), HiPass(sampleRate, 1000.f)}), Mixer(1.f)));
-    transforms.push_back(iterate(&clip));
+    auto quantum = vm["quantum"].as<unsigned long>();
+    Meters meters;
+    auto controls = std::make_shared<Controls>(sampleRate, std::max(vm["buffer-size"].as<unsigned long>(), quantum));
+    try
+    {
+        transforms.push_back([controls, plan = preset->instantiate(sampleRate, quantum ? quantum : 4096, &meters, controls.get())](const float *in, float *out, unsigned long samples) mutable {
+                controls->process(in, out, samples, plan);
+            });
+    }
+    catch(Plan::Exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    Looper::Settings looperSettings;
+    looperSettings.maxSeconds = vm["looper-seconds"].as<double>();
+    looperSettings.maxLayers = vm["looper-layers"].as<unsigned int>();
+    if(vm.count("looper-file"))
+        looperSettings.backingFile = vm["looper-file"].as<std::string>();
+    auto looper = std::make_shared<Looper>(sampleRate, std::move(looperSettings));
+    transforms.push_back([looper](const float *in, float *out, unsigned long samples) {
+            (*looper)(in, out, samples);
+        });
     std::atomic<float> volume(0.f);
     transforms.push_back(CalculateVolume([&volume](float arg) {
                 volume = arg;
@@ -160,8 +240,113 @@ int main(int argc, char *argv[])
                     }
                 }
             }));
-    AudioObject audio(chain(std::move(transforms)), sampleRate);
-    Webserver server("http_root");
+    std::unique_ptr<AudioBackend> backend;
+    auto backendName = vm["backend"].as<std::string>();
+    auto bufferSize = vm["buffer-size"].as<unsigned long>();
+    auto fake = backendName == "fake";
+    if(fake)
+    {
+        auto input = vm.count("fake-input") ? FakeAudioBackend::fileInput(vm["fake-input"].as<std::string>()) : FakeAudioBackend::silentInput();
+        auto output = vm.count("fake-output") ? FakeAudioBackend::fileOutput(vm["fake-output"].as<std::string>(), sampleRate) : FakeAudioBackend::discardOutput();
+        backend = std::make_unique<FakeAudioBackend>(std::move(input),
+                                                     std::move(output),
+                                                     sampleRate,
+                                                     bufferSize,
+                                                     vm.count("fake-realtime") > 0,
+                                                     static_cast<unsigned long>(vm["fake-duration"].as<double>() * sampleRate));
+    }
+    else if(backendName == "alsa")
+    {
+#ifdef PEDAL_HAVE_ALSA
+        AlsaBackend::Settings settings;
+        settings.device = vm["alsa-device"].as<std::string>();
+        settings.bufferSamples = bufferSize;
+        settings.periods = vm["alsa-periods"].as<unsigned int>();
+        settings.priority = vm["realtime-priority"].as<int>();
+        settings.cpu = vm["cpu"].as<int>();
+        try
+        {
+            backend = std::make_unique<AlsaBackend>(sampleRate, std::move(settings));
+        }
+        catch(AudioBackend::Exception const& e)
+        {
+            std::cerr << e.what() << "\nFalling back to portaudio" << std::endl;
+        }
+#else
+        std::cerr << "Built without ALSA support, falling back to portaudio" << std::endl;
+#endif
+    }
+    else if(backendName != "portaudio")
+    {
+        std::cerr << "Unknown backend: " << backendName << std::endl;
+        return 1;
+    }
+    if(!backend)
+        backend = std::make_unique<PortAudioBackend>(sampleRate, bufferSize);
+    SoundTransform effects;
+    try
+    {
+        effects = reblock(quantum, chain(std::move(transforms)), bufferSize);
+    }
+    catch(std::invalid_argument const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    auto recorder = std::make_shared<SessionRecorder>(sampleRate);
+    effects = [effects = std::move(effects), recorder](const float *in, float *out, unsigned long samples) {
+        effects(in, out, samples);
+        (*recorder)(in, out, samples);
+    };
+    if(vm.count("record"))
+    {
+        try
+        {
+            recorder->start(vm["record"].as<std::string>());
+        }
+        catch(SoundWriter::Exception const& e)
+        {
+            std::cerr << "Not recording: " << e.what() << std::endl;
+        }
+    }
+    if(quantum && bufferSize % quantum)
+        std::cerr << "Buffer size isn't a multiple of the quantum, adding " << quantum << " samples of latency" << std::endl;
+    AudioObject audio(std::move(effects), std::move(backend));
+#ifdef PEDAL_HAVE_ALSA
+    std::unique_ptr<MidiInput> midi;
+    if(vm.count("midi-map"))
+    {
+        try
+        {
+            midi = std::make_unique<MidiInput>(*controls, MidiInput::loadMappings(vm["midi-map"].as<std::string>()));
+            std::cerr << "MIDI input on sequencer port " << midi->getAddress() << std::endl;
+        }
+        catch(MidiInput::Exception const& e)
+        {
+            std::cerr << "No MIDI input: " << e.what() << std::endl;
+        }
+    }
+#else
+    if(vm.count("midi-map"))
+        std::cerr << "Built without ALSA support, no MIDI input" << std::endl;
+#endif
+    if(fake)
+    {
+        auto &fakeBackend = static_cast<FakeAudioBackend &>(audio.getBackend());
+        fakeBackend.wait();
+        auto const& stats = fakeBackend.getStats();
+        std::cout << "callbacks: " << stats.callbacks << "\n"
+                  << "realtime factor: " << stats.realtimeFactor() << "\n"
+                  << "max callback: " << stats.maxCallbackSeconds * 1e6 << " us\n"
+                  << "callback stddev: " << stats.callbackStdDevSeconds * 1e6 << " us\n"
+                  << "max lateness: " << stats.maxLatenessSeconds * 1e6 << " us\n"
+                  << "deadline misses: " << stats.deadlineMisses << std::endl;
+        return stats.deadlineMisses ? 2 : 0;
+    }
+    Webserver server("http_root",
+                     vm.count("watch-http-root") > 0,
+                     vm["http-threads"].as<unsigned int>(),
+                     vm["handler-threads"].as<unsigned int>());
     using namespace json11;
     server.handleMessage("getoutvolume", [&volume](Json const& args, Webserver::SendFunc send) {
             Json message = Json::object {
@@ -170,6 +355,12 @@ int main(int argc, char *argv[])
             };
             send(message.dump());
         });
+    server.handleMessage("setparam", [controls](Json const& args, Webserver::SendFunc send) {
+            auto const& name = args["name"].string_value();
+            auto at = static_cast<std::uint64_t>(std::max(0., args["at"].number_value()));
+            if(!controls->post(name, static_cast<float>(args["value"].number_value()), at))
+                std::cerr << "Control " << name << " unknown or its queue is full" << std::endl;
+        });
     server.handleMessage("getouthilow", [&hi, &low](Json const& args, Webserver::SendFunc send) {
             Json message = Json::object {
                 {"cmd", "outhilow"},
@@ -177,10 +368,11 @@ int main(int argc, char *argv[])
             };
             send(message.dump());
         });
-    server.handleMessage("getdynamicparameters", [](Json const& args, Webserver::SendFunc send) {
+    server.handleMessage("getdynamicparameters", [controls](Json const& args, Webserver::SendFunc send) {
             auto &id = args["id"];
             auto outargs = Json::object {
-                {"params", Json::array { "testvar", "wetdrymix" }}
+                {"params", controls->getNames()},
+                {"time", static_cast<double>(controls->getTime())},
             };
             if(!id.is_null())
                 outargs.insert(std::make_pair("id", id));
@@ -212,7 +404,105 @@ int main(int argc, char *argv[])
                         }};
                     send(message.dump());
                 });
+        }, Webserver::Execution::Worker);
+    server.handleMessage("looper", [looper](Json const& args, Webserver::SendFunc send) {
+            Looper::Action action;
+            if(!Looper::fromString(args["action"].string_value(), action))
+            {
+                std::cerr << "Unknown looper action: " << args["action"].dump() << std::endl;
+                return;
+            }
+            auto at = static_cast<std::uint64_t>(std::max(0., args["at"].number_value()));
+            if(!looper->post(action, at, args["quantize"].bool_value()))
+                std::cerr << "Looper command queue full" << std::endl;
+        });
+    server.handleMessage("setlooperquantum", [looper](Json const& args, Webserver::SendFunc send) {
+            looper->setQuantum(static_cast<std::uint64_t>(std::max(0., args["samples"].number_value())));
+        });
+    server.handleMessage("looperexport", [looper, recordings = vm["recordings"].as<std::string>()](Json const& args, Webserver::SendFunc send) {
+            auto filename = fileInDirectory(recordings, args["filename"].string_value());
+            if(filename.empty())
+                std::cerr << "Looper export not started: " << args["filename"].dump() << " isn't a plain file name" << std::endl;
+            else if(!looper->exportLoop(filename))
+                std::cerr << "Looper export not started" << std::endl;
+        }, Webserver::Execution::Worker);
+    server.handleMessage("getlooperstatus", [looper](Json const& args, Webserver::SendFunc send) {
+            auto status = looper->getStatus();
+            auto outargs = Json::object {
+                {"state", Looper::toString(status.state)},
+                {"layers", static_cast<int>(status.layers)},
+                {"length", static_cast<double>(status.length)},
+                {"position", static_cast<double>(status.position)},
+                {"time", static_cast<double>(status.time)},
+                {"exporting", status.exporting},
+            };
+            auto &id = args["id"];
+            if(!id.is_null())
+                outargs.insert(std::make_pair("id", id));
+            auto message = Json{Json::object {
+                    {"cmd", "looperstatus"},
+                    {"args", Json(outargs)},
+                }};
+            send(message.dump());
+        });
+    server.handleMessage("recorder", [recorder, recordings = vm["recordings"].as<std::string>()](Json const& args, Webserver::SendFunc send) {
+            auto const& action = args["action"].string_value();
+            if(action == "start")
+            {
+                auto filename = fileInDirectory(recordings, args["filename"].string_value());
+                if(filename.empty())
+                {
+                    std::cerr << "Recording not started: " << args["filename"].dump() << " isn't a plain file name" << std::endl;
+                    return;
+                }
+                try
+                {
+                    if(!recorder->start(filename))
+                        std::cerr << "Already recording" << std::endl;
+                }
+                catch(SoundWriter::Exception const& e)
+                {
+                    std::cerr << "Recording not started: " << e.what() << std::endl;
+                }
+            }
+            else if(action == "stop")
+                recorder->stop();
+            else
+                std::cerr << "Unknown recorder action: " << args["action"].dump() << std::endl;
+        }, Webserver::Execution::Worker);
+    server.handleMessage("getrecorderstatus", [recorder](Json const& args, Webserver::SendFunc send) {
+            auto status = recorder->getStatus();
+            auto outargs = Json::object {
+                {"recording", status.recording},
+                {"filename", status.filename},
+                {"frames", static_cast<double>(status.frames)},
+                {"droppedblocks", static_cast<double>(status.droppedBlocks)},
+                {"droppedframes", static_cast<double>(status.droppedFrames)},
+                {"error", status.error},
+            };
+            auto &id = args["id"];
+            if(!id.is_null())
+                outargs.insert(std::make_pair("id", id));
+            auto message = Json{Json::object {
+                    {"cmd", "recorderstatus"},
+                    {"args", Json(outargs)},
+                }};
+            send(message.dump());
+        });
+    server.handleMessage("getmeters", [&meters](Json const& args, Webserver::SendFunc send) {
+            auto outargs = Json::object {
+                {"meters", meters.toJson()},
+            };
+            auto &id = args["id"];
+            if(!id.is_null())
+                outargs.insert(std::make_pair("id", id));
+            auto message = Json{Json::object {
+                    {"cmd", "meters"},
+                    {"args", Json(outargs)},
+                }};
+            send(message.dump());
         });
+    server.start();
     std::cerr << "Press any key to stop" << std::endl;
     std::cin.get();
     //while(true) sleep(1);
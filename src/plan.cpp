@@ -0,0 +1,873 @@
+#include "plan.hpp"
+#include "drone.hpp"
+#include "dynamics.hpp"
+#include "effects.hpp"
+#include "neuralamp.hpp"
+#include "reverb.hpp"
+#include "waveshaper.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace deepness
+{
+    constexpr int PlanDescription::s_input;
+    constexpr int PlanDescription::s_output;
+
+    namespace
+    {
+        using Json = json11::Json;
+        using SampleFunc = std::function<float (float)>;
+
+        /*! What a stage gets to know about the plan it's built into. */
+        struct Context
+        {
+            double sampleRate;
+            Meters *meters;
+            Controls *controls;
+        };
+
+        struct StageFactory
+        {
+            std::function<SampleFunc (Json const& params, Context const& context)> sample;
+            std::function<SoundTransform (Json const& params, Context const& context)> block;
+            /*! whether the stage keeps no state and turns silence into silence */
+            std::function<bool (Json const& params)> stateless;
+            /*! longest silence in the tail the stage rings on with, 0 if it stops with its input */
+            float tailSeconds;
+            /*! outputs only the effect, not its input */
+            bool wetOnly;
+        };
+
+        // below -100 dB a block counts as silent
+        constexpr float s_silence = 1e-5f;
+        constexpr float s_fadeSeconds = 0.005f;
+
+        bool always(Json const&)
+        {
+            return true;
+        }
+
+        float number(Json const& params, const char *name, float fallback)
+        {
+            auto const& value = params[name];
+            return value.is_number() ? static_cast<float>(value.number_value()) : fallback;
+        }
+
+        /*! Registers \a setter as "name.parameter" if the stage has a "name".
+         *  \returns whether the parameter is a control */
+        bool control(Json const& params, Context const& context, std::string const& parameter, Controls::Setter setter)
+        {
+            auto const& name = params["name"].string_value();
+            if(!context.controls || name.empty())
+                return false;
+            if(!context.controls->add(name + "." + parameter, std::move(setter)))
+                throw Plan::Exception("Duplicate control " + name + "." + parameter);
+            return true;
+        }
+
+        SampleFunc makeGain(Json const& params, Context const& context)
+        {
+            auto gain = std::make_shared<float>(number(params, "gain", 1.f));
+            if(!control(params, context, "gain", [gain](float value) { *gain = value; }))
+                return Gain(*gain);
+            return [gain](float in) {
+                return in * *gain;
+            };
+        }
+
+        /*! Dynamics settings from a compressor, limiter or gate stage; unset parameters keep
+         *  defaults suited to the mode. */
+        SoundTransform makeDynamics(Dynamics::Mode mode, Json const& params, Context const& context)
+        {
+            Dynamics::Settings settings;
+            settings.mode = mode;
+            if(mode == Dynamics::Mode::Limiter)
+            {
+                settings.thresholdDb = -1.f;
+                settings.kneeDb = 0.f;
+                settings.attackMs = 1.f;
+                settings.releaseMs = 50.f;
+                settings.lookaheadMs = 1.f;
+            }
+            else if(mode == Dynamics::Mode::Gate)
+            {
+                settings.thresholdDb = -60.f;
+                settings.ratio = 10.f;
+                settings.attackMs = 1.f;
+                settings.releaseMs = 150.f;
+            }
+            settings.detector = params["detector"].string_value() == "rms" ? Dynamics::Detector::Rms : Dynamics::Detector::Peak;
+            settings.thresholdDb = number(params, "threshold", settings.thresholdDb);
+            settings.ratio = number(params, "ratio", settings.ratio);
+            settings.kneeDb = number(params, "knee", settings.kneeDb);
+            settings.attackMs = number(params, "attack", settings.attackMs);
+            settings.releaseMs = number(params, "release", settings.releaseMs);
+            settings.lookaheadMs = number(params, "lookahead", settings.lookaheadMs);
+            settings.makeupDb = number(params, "makeup", settings.makeupDb);
+            settings.rangeDb = number(params, "range", settings.rangeDb);
+            Meters::Meter meter;
+            auto const& name = params["meter"].string_value();
+            if(context.meters && !name.empty())
+                meter = context.meters->get(name);
+            return [dynamics = std::make_shared<Dynamics>(context.sampleRate, settings, meter)](const float *in, float *out, unsigned long samples) {
+                (*dynamics)(in, out, samples);
+            };
+        }
+
+        /*! A waveshaper from its "expression", "polynomial" or "points" parameter. */
+        SoundTransform makeWaveshaper(Json const& params)
+        {
+            Waveshaper::Settings settings;
+            settings.range = number(params, "range", settings.range);
+            settings.size = static_cast<unsigned int>(number(params, "size", static_cast<float>(settings.size)));
+            settings.interpolation = params["interpolation"].string_value() == "cubic" ? Waveshaper::Interpolation::Cubic : Waveshaper::Interpolation::Linear;
+            settings.antialias = params["antialias"].bool_value();
+            std::shared_ptr<Waveshaper> waveshaper;
+            try
+            {
+                if(params["expression"].is_string())
+                    waveshaper = std::make_shared<Waveshaper>(Waveshaper::parseExpression(params["expression"].string_value()), settings);
+                else if(params["polynomial"].is_array())
+                {
+                    std::vector<double> coefficients;
+                    for(auto const& coefficient: params["polynomial"].array_items())
+                        coefficients.push_back(coefficient.number_value());
+                    waveshaper = std::make_shared<Waveshaper>(coefficients, settings);
+                }
+                else if(params["points"].is_array())
+                {
+                    std::vector<std::pair<double, double>> points;
+                    for(auto const& point: params["points"].array_items())
+                        points.emplace_back(point[0].number_value(), point[1].number_value());
+                    waveshaper = std::make_shared<Waveshaper>(Waveshaper::piecewise(std::move(points)), settings);
+                }
+                else
+                    throw Plan::Exception("waveshaper needs an expression, polynomial or points");
+            }
+            catch(Waveshaper::Exception const& e)
+            {
+                throw Plan::Exception(e.what());
+            }
+            return [waveshaper](const float *in, float *out, unsigned long samples) {
+                (*waveshaper)(in, out, samples);
+            };
+        }
+
+        template<unsigned int Lines>
+        SoundTransform makeReverb(Json const& params, Context const& context)
+        {
+            typename Reverb<Lines>::Settings settings;
+            settings.decay = number(params, "decay", settings.decay);
+            settings.size = number(params, "size", settings.size);
+            settings.damping = number(params, "damping", settings.damping);
+            settings.modulation = number(params, "modulation", settings.modulation);
+            auto reverb = std::make_shared<Reverb<Lines>>(context.sampleRate, settings);
+            control(params, context, "decay", [reverb](float value) { reverb->setDecay(value); });
+            control(params, context, "size", [reverb](float value) { reverb->setSize(value); });
+            return [reverb](const float *in, float *out, unsigned long samples) {
+                (*reverb)(in, out, samples);
+            };
+        }
+
+        std::unordered_map<std::string, StageFactory> const& stageFactories()
+        {
+            const static std::unordered_map<std::string, StageFactory> factories {
+                {"passthrough", {[](Json const&, Context const&) -> SampleFunc { return &passthrough; }, nullptr, always}},
+                {"fuzz", {[](Json const&, Context const&) -> SampleFunc { return &fuzz; }, nullptr, always}},
+                {"clip", {[](Json const&, Context const&) -> SampleFunc { return &clip; }, nullptr, always}},
+                {"gain", {makeGain, nullptr, always}},
+                {"compress", {[](Json const& params, Context const&) -> SampleFunc { return Compress(number(params, "amount", 1.f)); }, nullptr, always}},
+                {"delay", {[](Json const&, Context const& context) -> SampleFunc { return Delay(context.sampleRate); }, nullptr, nullptr, 0.25f}},
+                {"drone", {[](Json const&, Context const& context) -> SampleFunc { return Drone(context.sampleRate); }, nullptr, nullptr, 0.05f}},
+                {"hipass", {[](Json const& params, Context const& context) { return HiPassSample(context.sampleRate, number(params, "amount", 1000.f)); }, nullptr}},
+                {"lopass", {[](Json const& params, Context const& context) { return LoPassSample(context.sampleRate, number(params, "amount", 1000.f)); }, nullptr}},
+                {"squareoctavedown", {[](Json const& params, Context const&) {
+                            return SquareOctaveDownSample(static_cast<int>(number(params, "octaves", 1.f)));
+                        }, nullptr}},
+                {"squaremultiplexoctavedown", {[](Json const& params, Context const&) -> SampleFunc {
+                            return [samplefunc = SquareOctaveDownSample(static_cast<int>(number(params, "octaves", 1.f)))](float in) mutable {
+                                return samplefunc(in) * in;
+                            };
+                        }, nullptr}},
+                {"absoctaveup", {[](Json const&, Context const&) -> SampleFunc { return [](float in) { return std::fabs(in); }; }, nullptr, always}},
+                {"octaveup", {nullptr, [](Json const&, Context const&) -> SoundTransform { return OctaveUp(); }, always}},
+                {"octavedown", {nullptr, [](Json const&, Context const&) -> SoundTransform { return OctaveDown(); }, always}},
+                {"waveshaper", {nullptr, [](Json const& params, Context const&) { return makeWaveshaper(params); }, [](Json const& params) {
+                            // antialiasing remembers the previous sample
+                            return !params["antialias"].bool_value();
+                        }}},
+                {"neuralamp", {nullptr, [](Json const& params, Context const&) -> SoundTransform {
+                            try
+                            {
+                                return NeuralAmp::load(params["model"].string_value());
+                            }
+                            catch(NeuralAmp::Exception const& e)
+                            {
+                                throw Plan::Exception(e.what());
+                            }
+                        }}},
+                {"reverb", {nullptr, [](Json const& params, Context const& context) {
+                            return number(params, "lines", 8.f) >= 16.f ? makeReverb<16>(params, context) : makeReverb<8>(params, context);
+                        }, nullptr, 0.25f, true}},
+                {"compressor", {nullptr, [](Json const& params, Context const& context) {
+                            return makeDynamics(Dynamics::Mode::Compressor, params, context);
+                        }}},
+                {"limiter", {nullptr, [](Json const& params, Context const& context) {
+                            return makeDynamics(Dynamics::Mode::Limiter, params, context);
+                        }}},
+                {"gate", {nullptr, [](Json const& params, Context const& context) {
+                            return makeDynamics(Dynamics::Mode::Gate, params, context);
+                        }}},
+            };
+            return factories;
+        }
+
+        const char *toString(PlanDescription::Step::Kind kind)
+        {
+            using Kind = PlanDescription::Step::Kind;
+            switch(kind)
+            {
+            case Kind::Samples:
+                return "samples";
+            case Kind::Block:
+                return "block";
+            case Kind::Mix:
+                return "mix";
+            case Kind::Copy:
+                return "copy";
+            case Kind::Split:
+                return "split";
+            case Kind::Sum:
+                return "sum";
+            }
+            return "";
+        }
+    }
+
+    bool isSampleStage(std::string const& type)
+    {
+        auto it = stageFactories().find(type);
+        return it != stageFactories().end() && it->second.sample;
+    }
+
+    bool isBlockStage(std::string const& type)
+    {
+        auto it = stageFactories().find(type);
+        return it != stageFactories().end() && it->second.block;
+    }
+
+    Json PlanDescription::toJson() const
+    {
+        Json::array jsonSteps;
+        for(auto const& step: steps)
+        {
+            Json::array jsonStages;
+            for(auto const& stage: step.stages)
+                jsonStages.push_back(stage.params);
+            Json::object jsonStep {
+                {"kind", toString(step.kind)},
+                {"stages", jsonStages},
+                {"in", Json::array {step.input0, step.input1}},
+                {"out", step.output},
+                {"mix", step.mix},
+            };
+            if(!step.buffers.empty())
+                jsonStep["buffers"] = Json(step.buffers);
+            if(step.steps0 || step.steps1)
+                jsonStep["paths"] = Json::array {static_cast<int>(step.steps0), static_cast<int>(step.steps1)};
+            jsonSteps.push_back(jsonStep);
+        }
+        return Json::object {
+            {"steps", jsonSteps},
+            {"scratch", static_cast<int>(scratchBuffers)},
+        };
+    }
+
+    bool PlanDescription::fromJson(Json const& json, PlanDescription &description)
+    {
+        using Kind = Step::Kind;
+        if(!json["steps"].is_array() || !json["scratch"].is_number())
+            return false;
+        PlanDescription result;
+        result.scratchBuffers = static_cast<unsigned int>(json["scratch"].int_value());
+        for(auto const& jsonStep: json["steps"].array_items())
+        {
+            Step step;
+            auto const& kind = jsonStep["kind"].string_value();
+            if(kind == "samples")
+                step.kind = Kind::Samples;
+            else if(kind == "block")
+                step.kind = Kind::Block;
+            else if(kind == "mix")
+                step.kind = Kind::Mix;
+            else if(kind == "copy")
+                step.kind = Kind::Copy;
+            else if(kind == "split")
+                step.kind = Kind::Split;
+            else if(kind == "sum")
+                step.kind = Kind::Sum;
+            else
+                return false;
+            for(auto const& stage: jsonStep["stages"].array_items())
+                step.stages.push_back(Stage{stage["type"].string_value(), stage});
+            step.input0 = jsonStep["in"][0].int_value();
+            step.input1 = jsonStep["in"][1].int_value();
+            step.output = jsonStep["out"].int_value();
+            step.mix = static_cast<float>(jsonStep["mix"].number_value());
+            for(auto const& buffer: jsonStep["buffers"].array_items())
+                step.buffers.push_back(buffer.int_value());
+            step.steps0 = static_cast<unsigned int>(std::max(0, jsonStep["paths"][0].int_value()));
+            step.steps1 = static_cast<unsigned int>(std::max(0, jsonStep["paths"][1].int_value()));
+            if(step.steps0 + step.steps1 > result.steps.size())
+                return false;
+            if((step.kind == Kind::Split || step.kind == Kind::Sum) && step.buffers.empty())
+                return false;
+            auto indices = step.buffers;
+            indices.insert(indices.end(), {step.input0, step.input1, step.output});
+            for(auto index: indices)
+            {
+                if(index < s_output || index >= static_cast<int>(result.scratchBuffers))
+                    return false;
+            }
+            result.steps.push_back(std::move(step));
+        }
+        description = std::move(result);
+        return true;
+    }
+
+    Plan::Plan(PlanDescription const& description, double sampleRate, unsigned long maxBlockSamples, Meters *meters, Controls *controls)
+        : m_scratch(description.scratchBuffers * maxBlockSamples, 0.f)
+        , m_maxBlockSamples(maxBlockSamples)
+        , m_zeros(maxBlockSamples, 0.f)
+        , m_silent(description.scratchBuffers + 2, 0)
+        , m_trackSilence(false)
+        , m_fadeStep(static_cast<float>(1. / (s_fadeSeconds * sampleRate)))
+        , m_current(0)
+        , m_controls(controls)
+        , m_controlBase(controls ? controls->size() : 0)
+        , m_changes(nullptr)
+        , m_changeCount(0)
+        , m_changeBegin(0)
+    {
+        using Kind = PlanDescription::Step::Kind;
+        Context context{sampleRate, meters, controls};
+        // the controls added since belong to the op built last
+        auto assignControls = [this, controls](int op) {
+            while(controls && m_controlBase + m_controlOps.size() < controls->size())
+                m_controlOps.push_back(op);
+        };
+        // per op, how long its tail can be silent and whether it keeps state at all
+        std::vector<unsigned long> tails;
+        std::vector<char> stateful;
+        for(auto const& step: description.steps)
+        {
+            assignControls(static_cast<int>(m_ops.size()) - 1);
+            tails.push_back(0);
+            stateful.push_back(step.kind == Kind::Split);
+            Op op;
+            op.kind = step.kind;
+            op.input0 = step.input0;
+            op.input1 = step.input1;
+            op.output = step.output;
+            op.mix = std::make_shared<float>(std::min(1.f, std::max(0.f, step.mix)));
+            op.current = *op.mix;
+            op.buffers = step.buffers;
+            op.pointers.resize(step.buffers.size());
+            op.stateless = false;
+            if(step.kind == Kind::Split)
+            {
+                if(step.stages.size() != 1 || step.stages.front().type != "crossover")
+                    throw Exception("Split step without a crossover");
+                std::vector<float> frequencies;
+                for(auto const& frequency: step.stages.front().params["frequencies"].array_items())
+                    frequencies.push_back(static_cast<float>(frequency.number_value()));
+                try
+                {
+                    op.crossover = std::make_shared<Crossover>(sampleRate, frequencies);
+                }
+                catch(Crossover::Exception const& e)
+                {
+                    throw Exception(e.what());
+                }
+                if(op.crossover->getBands() != step.buffers.size())
+                    throw Exception("Split step with the wrong number of buffers");
+                m_ops.push_back(std::move(op));
+                continue;
+            }
+            if(step.kind == Kind::Mix)
+            {
+                for(auto const& stage: step.stages)
+                {
+                    control(stage.params, context, "mix", [mix = op.mix](float value) {
+                            *mix = std::min(1.f, std::max(0.f, value));
+                        });
+                }
+                m_ops.push_back(std::move(op));
+                continue;
+            }
+            op.stateless = step.kind == Kind::Samples || step.kind == Kind::Block;
+            for(auto const& stage: step.stages)
+            {
+                auto it = stageFactories().find(stage.type);
+                if(it == stageFactories().end())
+                    throw Exception("Unknown stage type: " + stage.type);
+                if(step.kind == Kind::Samples && it->second.sample)
+                    op.stages.push_back(it->second.sample(stage.params, context));
+                else if(step.kind == Kind::Block && it->second.block)
+                    op.block = it->second.block(stage.params, context);
+                else
+                    throw Exception("Stage " + stage.type + " can't run in a " + toString(step.kind) + " step");
+                op.stateless = op.stateless && it->second.stateless && it->second.stateless(stage.params);
+                tails.back() = std::max(tails.back(), static_cast<unsigned long>(it->second.tailSeconds * sampleRate));
+            }
+            if(step.kind == Kind::Block && !op.block)
+                throw Exception("Block step without a stage");
+            if(op.stateless)
+            {
+                // a waveshaper's curve, say, needn't go through zero
+                std::vector<float> result(8, 1.f);
+                runStages(op, m_zeros.data(), result.data(), result.size());
+                op.stateless = std::all_of(result.begin(), result.end(), [](float value) { return std::fabs(value) < s_silence; });
+                m_trackSilence = m_trackSilence || op.stateless;
+            }
+            stateful.back() = !op.stateless;
+            auto const& params = step.stages.empty() ? Json() : step.stages.front().params;
+            if(step.stages.size() == 1 && (!params["name"].string_value().empty() || params["bypass"].is_bool()))
+            {
+                auto const& factory = stageFactories().find(step.stages.front().type)->second;
+                auto bypassed = params["bypass"].bool_value();
+                auto hold = static_cast<unsigned long>(factory.tailSeconds * sampleRate);
+                op.bypass = std::make_shared<Bypass>(Bypass{bypassed, bypassed ? 0.f : 1.f, !factory.wetOnly, hold, hold,
+                            std::vector<float>(maxBlockSamples), std::vector<float>(hold ? maxBlockSamples : 0)});
+                control(params, context, "bypass", [bypass = op.bypass](float value) {
+                        bypass->bypassed = value >= 0.5f;
+                    });
+            }
+            m_ops.push_back(std::move(op));
+        }
+        assignControls(static_cast<int>(m_ops.size()) - 1);
+        for(std::size_t i = 0; i < description.steps.size(); ++i)
+        {
+            auto const& step = description.steps[i];
+            if(step.steps0 + step.steps1 > i)
+                throw Exception("Mix step with more path steps than there are before it");
+            if(step.steps0)
+                m_ops[i - step.steps1 - step.steps0].gates.push_back(Gate{i, 0, step.steps0});
+            if(step.steps1)
+                m_ops[i - step.steps1].gates.push_back(Gate{i, 1, step.steps1});
+            for(int side = 0; side < 2; ++side)
+            {
+                auto length = side ? step.steps1 : step.steps0;
+                auto first = i - step.steps1 - (side ? 0 : step.steps0);
+                if(!length)
+                    continue;
+                auto &path = m_ops[i].paths[side];
+                std::vector<int> written;
+                for(auto k = first; k < first + length; ++k)
+                {
+                    auto const& pathStep = description.steps[k];
+                    // stateful stages without a tail still settle for a moment
+                    if(stateful[k])
+                        path.hold = std::max(path.hold, std::max(tails[k], static_cast<unsigned long>(s_fadeSeconds * sampleRate)));
+                    std::vector<int> reads;
+                    if(pathStep.kind == Kind::Sum)
+                        reads = pathStep.buffers;
+                    else
+                        reads.push_back(pathStep.input0);
+                    if(pathStep.kind == Kind::Mix)
+                        reads.push_back(pathStep.input1);
+                    for(auto read: reads)
+                    {
+                        if(std::find(written.begin(), written.end(), read) != written.end())
+                            continue;
+                        auto input = std::find_if(path.inputs.begin(), path.inputs.end(), [read](std::pair<int, std::size_t> const& input) {
+                                return input.first == read;
+                            });
+                        if(input == path.inputs.end())
+                            path.inputs.emplace_back(read, first + length - 1);
+                    }
+                    auto writes = pathStep.kind == Kind::Split ? pathStep.buffers : std::vector<int>{pathStep.output};
+                    for(auto write: writes)
+                    {
+                        if(std::find(written.begin(), written.end(), write) != written.end())
+                            continue;
+                        written.push_back(write);
+                        for(auto &input: path.inputs)
+                        {
+                            if(input.first == write)
+                                input.second = k;
+                        }
+                    }
+                }
+            }
+        }
+        m_mutes.reserve(m_ops.size());
+        for(auto &op: m_ops)
+        {
+            std::sort(op.gates.begin(), op.gates.end(), [](Gate const& a, Gate const& b) {
+                    return a.length > b.length;
+                });
+        }
+    }
+
+    void Plan::operator()(const float *in, float *out, unsigned long samples)
+    {
+        operator()(in, out, samples, nullptr, 0);
+    }
+
+    void Plan::operator()(const float *in, float *out, unsigned long samples, Controls::Change const *changes, std::size_t count)
+    {
+        m_changes = changes;
+        m_changeCount = count;
+        m_changeBegin = 0;
+        while(samples > m_maxBlockSamples)
+        {
+            process(in, out, m_maxBlockSamples);
+            in += m_maxBlockSamples;
+            out += m_maxBlockSamples;
+            samples -= m_maxBlockSamples;
+            m_changeBegin += m_maxBlockSamples;
+        }
+        process(in, out, samples);
+        m_changeCount = 0;
+    }
+
+    int Plan::owner(unsigned int control) const
+    {
+        if(control < m_controlBase || control - m_controlBase >= m_controlOps.size())
+            return -1;
+        return m_controlOps[control - m_controlBase];
+    }
+
+    void Plan::applyChanges(int index)
+    {
+        for(std::size_t i = 0; i < m_changeCount; ++i)
+        {
+            auto const& change = m_changes[i];
+            if(change.offset >= m_changeBegin && change.offset < m_changeBegin + m_maxBlockSamples && owner(change.control) == index)
+                m_controls->apply(change);
+        }
+    }
+
+    template<typename Func>
+    void Plan::splitAtChanges(std::size_t index, unsigned long samples, Func func)
+    {
+        unsigned long done = 0;
+        for(std::size_t i = 0; i < m_changeCount; ++i)
+        {
+            auto const& change = m_changes[i];
+            if(change.offset < m_changeBegin || change.offset >= m_changeBegin + samples || owner(change.control) != static_cast<int>(index))
+                continue;
+            auto offset = change.offset - m_changeBegin;
+            if(offset > done)
+            {
+                func(done, offset - done);
+                done = offset;
+            }
+            m_controls->apply(change);
+        }
+        if(done < samples)
+            func(done, samples - done);
+    }
+
+    float *Plan::buffer(int index, const float *in, float *out)
+    {
+        if(index == PlanDescription::s_input)
+            // never written, the compiler doesn't assign the input as an output
+            return const_cast<float *>(in);
+        if(index == PlanDescription::s_output)
+            return out;
+        return m_scratch.data() + index * m_maxBlockSamples;
+    }
+
+    const float *Plan::source(int index, const float *in, float *out)
+    {
+        return muted(index) ? m_zeros.data() : buffer(index, in, out);
+    }
+
+    bool Plan::muted(int index) const
+    {
+        for(auto const& mute: m_mutes)
+        {
+            for(auto const& input: mute.path->inputs)
+            {
+                if(input.first == index && m_current <= input.second)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool Plan::silentSource(int index)
+    {
+        return muted(index) || silent(index);
+    }
+
+    char &Plan::silent(int index)
+    {
+        return m_silent[index - PlanDescription::s_output];
+    }
+
+    void Plan::process(const float *in, float *out, unsigned long samples)
+    {
+        if(m_trackSilence)
+        {
+            auto peak = 0.f;
+            for(decltype(samples) i = 0; i < samples; ++i)
+                peak = std::max(peak, std::fabs(in[i]));
+            silent(PlanDescription::s_input) = peak < s_silence;
+        }
+        applyChanges(-1);
+        m_mutes.clear();
+        for(std::size_t i = 0; i < m_ops.size();)
+        {
+            while(!m_mutes.empty() && m_mutes.back().end <= i)
+                m_mutes.pop_back();
+            auto &op = m_ops[i];
+            unsigned int skip = 0;
+            for(auto const& gate: op.gates)
+            {
+                using Mode = Path::Mode;
+                auto &mixOp = m_ops[gate.mix];
+                auto &path = mixOp.paths[gate.side];
+                auto heard = gate.side ? mixOp.current > 0.f || *mixOp.mix > 0.f : mixOp.current < 1.f || *mixOp.mix < 1.f;
+                if(heard)
+                {
+                    path.mode = Mode::Heard;
+                    path.quiet = 0;
+                }
+                else if(path.quiet < path.hold)
+                {
+                    path.mode = Mode::RingOut;
+                    m_mutes.push_back(Mute{i + gate.length, &path});
+                }
+                else
+                {
+                    path.mode = Mode::Skipped;
+                    skip = gate.length;
+                    break;
+                }
+            }
+            if(skip)
+            {
+                for(auto end = i + skip; i < end; ++i)
+                    applyChanges(static_cast<int>(i));
+                continue;
+            }
+            run(i, in, out, samples);
+            ++i;
+        }
+    }
+
+    void Plan::run(std::size_t index, const float *in, float *out, unsigned long samples)
+    {
+        using Kind = PlanDescription::Step::Kind;
+        auto &op = m_ops[index];
+        m_current = index;
+        auto *input0 = source(op.input0, in, out);
+        auto *output = buffer(op.output, in, out);
+        auto bypassing = op.bypass && (op.bypass->bypassed || op.bypass->gain < 1.f);
+        auto skipSilence = op.stateless && silentSource(op.input0);
+        if(op.kind == Kind::Samples && !bypassing && !skipSilence)
+        {
+            // a fused per-sample run can stop anywhere, so changes land on their sample
+            splitAtChanges(index, samples, [&](unsigned long begin, unsigned long length) {
+                    runStages(op, input0 + begin, output + begin, length);
+                });
+            silent(op.output) = false;
+            return;
+        }
+        // a mix splits at its changes itself
+        if(op.kind != Kind::Mix)
+            applyChanges(static_cast<int>(index));
+        switch(op.kind)
+        {
+        case Kind::Samples:
+        case Kind::Block:
+            if(op.bypass && (op.bypass->bypassed || op.bypass->gain < 1.f))
+                runBypass(op, input0, output, samples);
+            else if(op.stateless && silentSource(op.input0))
+            {
+                std::fill_n(output, samples, 0.f);
+                silent(op.output) = true;
+            }
+            else
+            {
+                runStages(op, input0, output, samples);
+                silent(op.output) = false;
+            }
+            break;
+        case Kind::Mix:
+        {
+            using Mode = Path::Mode;
+            auto *input1 = source(op.input1, in, out);
+            for(int side = 0; side < 2; ++side)
+            {
+                auto &path = op.paths[side];
+                if(path.mode != Mode::RingOut)
+                    continue;
+                auto *tail = side ? input1 : input0;
+                auto peak = 0.f;
+                for(decltype(samples) i = 0; i < samples; ++i)
+                    peak = std::max(peak, std::fabs(tail[i]));
+                path.quiet = peak < s_silence ? path.quiet + samples : 0;
+            }
+            // a side that didn't run holds nothing, and then the mix is all the other side
+            auto ramp = op.paths[0].mode == Mode::Heard && op.paths[1].mode == Mode::Heard;
+            auto silence = true;
+            splitAtChanges(index, samples, [&](unsigned long begin, unsigned long length) {
+                    auto target = *op.mix;
+                    auto &current = op.current;
+                    if((current == target || !ramp) && (current == 0.f || current == 1.f))
+                    {
+                        auto side = current == 0.f ? op.input0 : op.input1;
+                        auto *from = current == 0.f ? input0 : input1;
+                        if(from != output)
+                            std::copy_n(from + begin, length, output + begin);
+                        silence = silence && silentSource(side);
+                    }
+                    else if(silentSource(op.input0) && silentSource(op.input1))
+                    {
+                        std::fill_n(output + begin, length, 0.f);
+                        auto distance = ramp ? m_fadeStep * static_cast<float>(length) : 0.f;
+                        current = target > current ? std::min(target, current + distance) : std::max(target, current - distance);
+                    }
+                    else
+                    {
+                        auto step = ramp ? m_fadeStep : 0.f;
+                        for(auto i = begin; i < begin + length; ++i)
+                        {
+                            current = target > current ? std::min(target, current + step) : std::max(target, current - step);
+                            output[i] = input1[i] * current + input0[i] * (1.f - current);
+                        }
+                        silence = false;
+                    }
+                });
+            silent(op.output) = silence;
+            return;
+        }
+        case Kind::Copy:
+            std::copy_n(input0, samples, output);
+            silent(op.output) = silentSource(op.input0);
+            break;
+        case Kind::Split:
+            for(std::size_t band = 0; band < op.buffers.size(); ++band)
+            {
+                op.pointers[band] = buffer(op.buffers[band], in, out);
+                silent(op.buffers[band]) = false;
+            }
+            (*op.crossover)(input0, op.pointers.data(), samples);
+            break;
+        case Kind::Sum:
+        {
+            auto silence = true;
+            for(std::size_t band = 0; band < op.buffers.size(); ++band)
+            {
+                op.pointers[band] = const_cast<float *>(source(op.buffers[band], in, out));
+                silence = silence && silentSource(op.buffers[band]);
+            }
+            if(silence)
+            {
+                std::fill_n(output, samples, 0.f);
+                silent(op.output) = true;
+                break;
+            }
+            // sample by sample, the output may be one of the inputs
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                auto sum = 0.f;
+                for(auto *band: op.pointers)
+                    sum += band[i];
+                output[i] = sum;
+            }
+            silent(op.output) = false;
+            break;
+        }
+        }
+    }
+
+    void Plan::runStages(Op &op, const float *input, float *output, unsigned long samples)
+    {
+        if(op.block)
+        {
+            op.block(input, output, samples);
+        }
+        else if(op.stages.size() == 1)
+        {
+            auto &stage = op.stages.front();
+            for(decltype(samples) i = 0; i < samples; ++i)
+                output[i] = stage(input[i]);
+        }
+        else
+        {
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                auto value = input[i];
+                for(auto &stage: op.stages)
+                    value = stage(value);
+                output[i] = value;
+            }
+        }
+    }
+
+    void Plan::runBypass(Op &op, const float *input, float *output, unsigned long samples)
+    {
+        auto &bypass = *op.bypass;
+        auto dry = bypass.dry ? 1.f : 0.f;
+        auto target = bypass.bypassed ? 0.f : 1.f;
+        if(bypass.gain != target)
+        {
+            // crossfade, keeping the input as the output may overwrite it
+            auto *kept = bypass.input.data();
+            std::copy_n(input, samples, kept);
+            auto start = bypass.gain;
+            auto step = bypass.bypassed ? -m_fadeStep : m_fadeStep;
+            auto gain = [start, step](unsigned long i) {
+                return std::min(1.f, std::max(0.f, start + step * static_cast<float>(i + 1)));
+            };
+            if(bypass.hold)
+            {
+                // the stage's input fades rather than its output, so it rings on
+                for(decltype(samples) i = 0; i < samples; ++i)
+                    bypass.tail[i] = kept[i] * gain(i);
+                runStages(op, bypass.tail.data(), output, samples);
+                for(decltype(samples) i = 0; i < samples; ++i)
+                    output[i] += dry * kept[i] * (1.f - gain(i));
+            }
+            else
+            {
+                runStages(op, kept, output, samples);
+                for(decltype(samples) i = 0; i < samples; ++i)
+                    output[i] = output[i] * gain(i) + dry * kept[i] * (1.f - gain(i));
+            }
+            bypass.gain = samples ? gain(samples - 1) : start;
+            if(bypass.bypassed)
+                bypass.quiet = 0;
+            silent(op.output) = false;
+        }
+        else if(bypass.quiet < bypass.hold)
+        {
+            // bypassed, but the tail goes on until it has been silent for a while
+            runStages(op, m_zeros.data(), bypass.tail.data(), samples);
+            auto peak = 0.f;
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                peak = std::max(peak, std::fabs(bypass.tail[i]));
+                output[i] = dry * input[i] + bypass.tail[i];
+            }
+            bypass.quiet = peak < s_silence ? bypass.quiet + samples : 0;
+            silent(op.output) = false;
+        }
+        else if(bypass.dry)
+        {
+            if(input != output)
+                std::copy_n(input, samples, output);
+            silent(op.output) = silentSource(op.input0);
+        }
+        else
+        {
+            std::fill_n(output, samples, 0.f);
+            silent(op.output) = true;
+        }
+    }
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include "controls.hpp"
+#include "crossover.hpp"
+#include "meters.hpp"
+#include <json11.hpp>
+#include <array>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace deepness
+{
+    /*! A flattened effect graph: a list of steps reading and writing numbered buffers.
+     *  Produced by the preset compiler, cached on disk as JSON and turned into a runnable
+     *  Plan for a sample rate. */
+    struct PlanDescription
+    {
+        /*! buffer indices below zero are the external input and output, the rest scratch */
+        static constexpr int s_input = -1;
+        static constexpr int s_output = -2;
+
+        struct Stage
+        {
+            std::string type;
+            /*! the stage's preset object, with its parameters */
+            json11::Json params;
+        };
+        struct Step
+        {
+            enum class Kind
+            {
+                /*! a fused run of per-sample stages, computed in one pass */
+                Samples,
+                /*! one stage that needs the whole block */
+                Block,
+                /*! output = input1 * mix + input0 * (1 - mix), stages may hold the named node whose
+                 *  mix is a control */
+                Mix,
+                Copy,
+                /*! a "crossover" stage writing input0 split into bands to buffers */
+                Split,
+                /*! output = the sum of buffers */
+                Sum,
+            };
+            Kind kind;
+            std::vector<Stage> stages;
+            int input0;
+            int input1;
+            int output;
+            float mix;
+            /*! the band outputs of a Split, the inputs of a Sum */
+            std::vector<int> buffers;
+            /*! Mix: how many of the steps right before it compute only input1, and how many
+             *  before those only input0. They don't run while their side is mixed in at 0. */
+            unsigned int steps0 = 0;
+            unsigned int steps1 = 0;
+        };
+
+        std::vector<Step> steps;
+        unsigned int scratchBuffers = 0;
+
+        json11::Json toJson() const;
+        /*! \returns false if \a json isn't a valid description */
+        static bool fromJson(json11::Json const& json, PlanDescription &description);
+    };
+
+    /*! Stage types the plan knows how to build. */
+    bool isSampleStage(std::string const& type);
+    bool isBlockStage(std::string const& type);
+
+    /*! Runs a PlanDescription. All buffers are allocated up front for blocks of up to
+     *  maxBlockSamples; longer blocks are processed in pieces. Input and output must not
+     *  alias. Stages with a "meter" parameter publish to \a meters if given, stages with a
+     *  "name" register their parameters with \a controls as "name.parameter" if given.
+     *
+     *  Run through Controls::process(), a change to a per-sample stage lands on its exact
+     *  sample, the fused step is split there. Block stages always see the whole block, their
+     *  changes apply at its start, so stages like "octaveup" keep their block size.
+     *
+     *  Work that can't be heard is skipped: paths mixed in at 0 and stages bypassed through
+     *  their "bypass" parameter or control, both once their tail has died down, and
+     *  stateless stages whose input block is silent. Mix changes ramp over a few ms. */
+    class Plan
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+
+        Plan(PlanDescription const& description, double sampleRate, unsigned long maxBlockSamples = 4096, Meters *meters = nullptr, Controls *controls = nullptr);
+        void operator()(const float *in, float *out, unsigned long samples);
+        /*! Applies \a changes of the Controls the plan was built with while processing. */
+        void operator()(const float *in, float *out, unsigned long samples, Controls::Change const *changes, std::size_t count);
+    private:
+        using SampleFunc = std::function<float (float)>;
+        using BlockFunc = std::function<void (const float *, float *, unsigned long)>;
+        /*! State of a bypassable stage, shared with its control. */
+        struct Bypass
+        {
+            /*! what the control asks for */
+            bool bypassed;
+            /*! 1 running, 0 bypassed, in between while crossfading */
+            float gain;
+            /*! the output with the stage bypassed is the input, or silence for wet only stages */
+            bool dry;
+            /*! samples of silence that end the tail, 0 for stages without one */
+            unsigned long hold;
+            /*! samples the tail has been silent for */
+            unsigned long quiet;
+            std::vector<float> input;
+            std::vector<float> tail;
+        };
+        /*! Skips the next \a length ops while the mix op's \a side is mixed in at 0. */
+        struct Gate
+        {
+            std::size_t mix;
+            int side;
+            unsigned int length;
+        };
+        /*! A path into a Mix op. Once mixed in at 0 it runs on silence until its tail has
+         *  been quiet for a while, so that no stale tail comes back when it's mixed in again,
+         *  and is skipped from then on. */
+        struct Path
+        {
+            enum class Mode
+            {
+                Heard,
+                RingOut,
+                Skipped,
+            };
+            Mode mode = Mode::Heard;
+            /*! samples of silence that end the tail */
+            unsigned long hold = 0;
+            unsigned long quiet = 0;
+            /*! buffers the path reads from outside, each with the last op that reads it before
+             *  the path overwrites it */
+            std::vector<std::pair<int, std::size_t>> inputs;
+        };
+        /*! The inputs of \a path read as silence up to op \a end. */
+        struct Mute
+        {
+            std::size_t end;
+            Path const *path;
+        };
+        struct Op
+        {
+            PlanDescription::Step::Kind kind;
+            std::vector<SampleFunc> stages;
+            BlockFunc block;
+            std::shared_ptr<Crossover> crossover;
+            int input0;
+            int input1;
+            int output;
+            /*! shared with its control, which may outlive a copy of the plan */
+            std::shared_ptr<float> mix;
+            /*! the mix heard, ramping towards *mix */
+            float current;
+            /*! Mix: what feeds input0 and input1 */
+            std::array<Path, 2> paths;
+            std::vector<int> buffers;
+            /*! buffers resolved for the current block, sized up front */
+            std::vector<float *> pointers;
+            /*! maps silence to silence without keeping state */
+            bool stateless;
+            std::shared_ptr<Bypass> bypass;
+            /*! outermost first */
+            std::vector<Gate> gates;
+        };
+        void process(const float *in, float *out, unsigned long samples);
+        void run(std::size_t index, const float *in, float *out, unsigned long samples);
+        /*! the op a control belongs to, -1 for other plans' controls */
+        int owner(unsigned int control) const;
+        /*! Applies the changes of op \a index due in the current block. */
+        void applyChanges(int index);
+        /*! Calls \a func(begin, length) for the pieces of the block between the changes of op
+         *  \a index, applying them in between. */
+        template<typename Func>
+        void splitAtChanges(std::size_t index, unsigned long samples, Func func);
+        void runStages(Op &op, const float *input, float *output, unsigned long samples);
+        void runBypass(Op &op, const float *input, float *output, unsigned long samples);
+        float *buffer(int index, const float *in, float *out);
+        /*! buffer \a index as the current op reads it, silence if it's a muted path input */
+        const float *source(int index, const float *in, float *out);
+        bool muted(int index) const;
+        /*! whether the current op reads silence from buffer \a index */
+        bool silentSource(int index);
+        char &silent(int index);
+
+        std::vector<Op> m_ops;
+        std::vector<float> m_scratch;
+        unsigned long m_maxBlockSamples;
+        std::vector<float> m_zeros;
+        /*! per buffer, whether its current block is silent, input and output first */
+        std::vector<char> m_silent;
+        bool m_trackSilence;
+        float m_fadeStep;
+        /*! paths ringing out in the current block, innermost last */
+        std::vector<Mute> m_mutes;
+        std::size_t m_current;
+        Controls *m_controls;
+        /*! index of the plan's first control */
+        std::size_t m_controlBase;
+        /*! per control from m_controlBase, the op it belongs to */
+        std::vector<int> m_controlOps;
+        // changes of the current call, and the offset the block being processed starts at
+        Controls::Change const *m_changes;
+        std::size_t m_changeCount;
+        unsigned long m_changeBegin;
+    };
+}
@@ -0,0 +1,106 @@
+#include "portaudiobackend.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace deepness
+{
+    std::ostream &operator<<(std::ostream &out, const PaHostApiInfo *api)
+    {
+        return out << api->name;
+    }
+
+    std::ostream &operator<<(std::ostream &out, const PaDeviceInfo *device)
+    {
+        return out << "name: " << device->name << "\n"
+                   << "api: " << Pa_GetHostApiInfo(device->hostApi) << "\n"
+                   << "max input channels: " << device->maxInputChannels << "\n"
+                   << "max output channels: " << device->maxOutputChannels << "\n"
+                   << "defaultLowInputLatency: " << device->defaultLowInputLatency << "\n"
+                   << "defaultLowOutputLatency: " << device->defaultLowOutputLatency << "\n"
+                   << "defaultSampleRate: " << device->defaultSampleRate << "\n";
+    }
+
+    PortAudioBackend::PortAudioBackend(double sampleRate, unsigned long bufferSamples)
+        :m_stream(nullptr)
+    {
+        auto err = Pa_Initialize();
+        if(paNoError != err)
+            throw Exception(std::string("Error initializing port audio: ") + Pa_GetErrorText(err));
+        PaStreamParameters inputParameters;
+        std::memset(&inputParameters, 0, sizeof(PaStreamParameters));
+        auto device = Pa_GetDefaultInputDevice();
+        if(Pa_GetDefaultOutputDevice() != device)
+            std::cerr << "Different input and output default devices found. Using input";
+        std::cerr << "Using device: \n" << Pa_GetDeviceInfo(device);
+        inputParameters.device = device;
+        if(paNoDevice == inputParameters.device)
+            throw Exception("Error finding default input device");
+        inputParameters.channelCount = 1;
+        inputParameters.sampleFormat = paFloat32;
+        inputParameters.suggestedLatency = Pa_GetDeviceInfo(inputParameters.device)->defaultLowInputLatency;
+
+        PaStreamParameters outputParameters;
+        std::memset(&outputParameters, 0, sizeof(PaStreamParameters));
+        outputParameters.device = Pa_GetDefaultOutputDevice();
+        if(paNoDevice == outputParameters.device)
+            throw Exception("Error finding default output device");
+        outputParameters.channelCount = 1;
+        outputParameters.sampleFormat = paFloat32;
+        outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
+        err = Pa_OpenStream(&m_stream,
+                            &inputParameters,
+                            &outputParameters,
+                            sampleRate,
+                            bufferSamples,
+                            paNoFlag,
+                            rawcallback,
+                            this);
+        if(paNoError != err)
+            throw Exception(std::string("Error opening audio stream: ") + Pa_GetErrorText(err));
+    }
+
+    PortAudioBackend::~PortAudioBackend()
+    {
+        if(m_stream)
+        {
+            auto err = Pa_CloseStream(m_stream);
+            if(paNoError != err)
+                std::cerr << "Error closing audio stream: " << Pa_GetErrorText(err) << std::endl;
+        }
+        Pa_Terminate();
+    }
+
+    void PortAudioBackend::start(CallbackFunc callback)
+    {
+        m_callback = std::move(callback);
+        auto err = Pa_StartStream(m_stream);
+        if(paNoError != err)
+            throw Exception(std::string("Error starting audio stream: ") + Pa_GetErrorText(err));
+    }
+
+    void PortAudioBackend::stop()
+    {
+        auto err = Pa_StopStream(m_stream);
+        if(paNoError != err)
+            throw Exception(std::string("Error stopping audio stream: ") + Pa_GetErrorText(err));
+    }
+
+    int PortAudioBackend::rawcallback(const void *inputBuffer,
+                                      void *outputBuffer,
+                                      unsigned long framesPerBuffer,
+                                      const PaStreamCallbackTimeInfo* timeInfo,
+                                      PaStreamCallbackFlags statusFlags,
+                                      void *userData)
+    {
+        auto *backend = static_cast<PortAudioBackend *>(userData);
+        backend->m_callback(static_cast<const float *>(inputBuffer),
+                            static_cast<float *>(outputBuffer),
+                            framesPerBuffer);
+        return paContinue;
+    }
+
+    double PortAudioBackend::getSampleRate() const
+    {
+        return Pa_GetStreamInfo(m_stream)->sampleRate;
+    }
+}
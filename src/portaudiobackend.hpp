@@ -0,0 +1,29 @@
+#pragma once
+
+#include "audiobackend.hpp"
+#include <portaudio.h>
+
+namespace deepness
+{
+    /*! Mono in/out on the default PortAudio devices. */
+    class PortAudioBackend: public AudioBackend
+    {
+    public:
+        PortAudioBackend(double sampleRate, unsigned long bufferSamples = 64);
+        ~PortAudioBackend();
+        PortAudioBackend(PortAudioBackend const&) =delete;
+        PortAudioBackend & operator=(PortAudioBackend const&) =delete;
+        void start(CallbackFunc callback) override;
+        void stop() override;
+        double getSampleRate() const override;
+    private:
+        static int rawcallback(const void *inputBuffer,
+                               void *outputBuffer,
+                               unsigned long framesPerBuffer,
+                               const PaStreamCallbackTimeInfo* timeInfo,
+                               PaStreamCallbackFlags statusFlags,
+                               void *userData);
+        PaStream *m_stream;
+        CallbackFunc m_callback;
+    };
+}
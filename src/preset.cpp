@@ -0,0 +1,453 @@
+#include "preset.hpp"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+namespace deepness
+{
+    namespace
+    {
+        using Json = json11::Json;
+        using Step = PlanDescription::Step;
+        using Kind = Step::Kind;
+
+        // bump when the compiler output changes, so stale cache entries are ignored
+        const char *s_compilerVersion = "pedal-plan-6";
+
+        struct Node
+        {
+            std::string type;
+            Json params;
+            std::vector<std::vector<Node>> paths;
+            float mix;
+        };
+        using Chain = std::vector<Node>;
+
+        float clampedMix(Json const& node)
+        {
+            return std::min(1.f, std::max(0.f, static_cast<float>(node["mix"].number_value())));
+        }
+
+        /*! Named nodes have parameters that can change while running, so they stay. */
+        bool named(Node const& node)
+        {
+            return !node.params["name"].string_value().empty();
+        }
+
+        /*! Stages that can be bypassed get a step of their own, so the rest of a run of
+         *  per-sample stages keeps going without them. */
+        bool bypassable(Node const& node)
+        {
+            return named(node) || node.params["bypass"].is_bool();
+        }
+
+        /*! What a Mix step keeps of a named node, without its paths. */
+        std::vector<PlanDescription::Stage> mixStages(Node const& node)
+        {
+            if(!named(node))
+                return {};
+            return {PlanDescription::Stage{node.type, Json::object {{"type", node.type}, {"name", node.params["name"]}}}};
+        }
+
+        Chain parseChain(Json const& chain, std::string const& where)
+        {
+            if(!chain.is_array())
+                throw Preset::Exception(where + " is not an array");
+            Chain result;
+            auto index = 0;
+            for(auto const& item: chain.array_items())
+            {
+                auto itemWhere = where + "[" + std::to_string(index++) + "]";
+                auto const& type = item["type"];
+                if(!type.is_string())
+                    throw Preset::Exception(itemWhere + " has no type");
+                Node node{type.string_value(), item, {}, 0.f};
+                if(node.type == "chain")
+                {
+                    node.paths.push_back(parseChain(item["chain"], itemWhere + ".chain"));
+                }
+                else if(node.type == "wetdry")
+                {
+                    node.paths.push_back(parseChain(item["chain"], itemWhere + ".chain"));
+                    node.mix = clampedMix(item);
+                }
+                else if(node.type == "splitcombine")
+                {
+                    auto const& paths = item["paths"];
+                    if(paths.array_items().size() != 2)
+                        throw Preset::Exception(itemWhere + ".paths needs two paths");
+                    node.paths.push_back(parseChain(paths[0], itemWhere + ".paths[0]"));
+                    node.paths.push_back(parseChain(paths[1], itemWhere + ".paths[1]"));
+                    node.mix = clampedMix(item);
+                }
+                else if(node.type == "multiband")
+                {
+                    auto const& frequencies = item["frequencies"].array_items();
+                    auto const& bands = item["bands"].array_items();
+                    if(bands.size() != frequencies.size() + 1)
+                        throw Preset::Exception(itemWhere + ".bands needs one chain more than there are frequencies");
+                    if(bands.size() > Crossover::s_maxBands)
+                        throw Preset::Exception(itemWhere + " has more than " + std::to_string(Crossover::s_maxBands) + " bands");
+                    for(std::size_t i = 0; i < frequencies.size(); ++i)
+                    {
+                        if(!frequencies[i].is_number() || frequencies[i].number_value() <= 0.
+                           || (i > 0 && frequencies[i].number_value() <= frequencies[i - 1].number_value()))
+                            throw Preset::Exception(itemWhere + ".frequencies must be increasing numbers");
+                    }
+                    for(std::size_t i = 0; i < bands.size(); ++i)
+                        node.paths.push_back(parseChain(bands[i], itemWhere + ".bands[" + std::to_string(i) + "]"));
+                }
+                else if(!isSampleStage(node.type) && !isBlockStage(node.type))
+                {
+                    throw Preset::Exception(itemWhere + " has unknown type " + node.type);
+                }
+                result.push_back(std::move(node));
+            }
+            return result;
+        }
+
+        /*! Removes everything that doesn't change the output and inlines nested chains. */
+        Chain optimize(Chain const& chain)
+        {
+            Chain result;
+            auto append = [&result](Chain path) {
+                std::move(path.begin(), path.end(), std::back_inserter(result));
+            };
+            for(auto const& node: chain)
+            {
+                if(node.type == "passthrough")
+                    continue;
+                if(node.type == "gain" && node.params["gain"].is_number() && node.params["gain"].number_value() == 1. && !named(node))
+                    continue;
+                if(node.type == "chain")
+                {
+                    append(optimize(node.paths[0]));
+                }
+                else if(node.type == "wetdry")
+                {
+                    auto wet = optimize(node.paths[0]);
+                    // an empty wet path mixes the input with itself, but a named node keeps
+                    // its mix control
+                    if((wet.empty() || node.mix <= 0.f) && !named(node))
+                        continue;
+                    if(node.mix >= 1.f && !named(node))
+                    {
+                        append(std::move(wet));
+                        continue;
+                    }
+                    result.push_back(Node{node.type, node.params, {std::move(wet)}, node.mix});
+                }
+                else if(node.type == "splitcombine")
+                {
+                    auto path0 = optimize(node.paths[0]);
+                    auto path1 = optimize(node.paths[1]);
+                    if(node.mix <= 0.f && !named(node))
+                        append(std::move(path0));
+                    else if(node.mix >= 1.f && !named(node))
+                        append(std::move(path1));
+                    else if(!path0.empty() || !path1.empty() || named(node))
+                        result.push_back(Node{node.type, node.params, {std::move(path0), std::move(path1)}, node.mix});
+                }
+                else if(node.type == "multiband")
+                {
+                    std::vector<Chain> bands;
+                    for(auto const& band: node.paths)
+                        bands.push_back(optimize(band));
+                    // kept even with every band empty, the bands then sum to an allpass and
+                    // dropping the node would change the phase the preset asked for
+                    if(bands.size() == 1)
+                        append(std::move(bands.front()));
+                    else
+                        result.push_back(Node{node.type, Json::object {{"frequencies", node.params["frequencies"]}}, std::move(bands), 0.f});
+                }
+                else
+                {
+                    result.push_back(node);
+                }
+            }
+            return result;
+        }
+
+        /*! Turns the tree into steps on virtual buffers, 0 being the input. Every virtual
+         *  buffer is written exactly once. */
+        class Lowering
+        {
+        public:
+            int lower(Chain const& chain, int input)
+            {
+                std::vector<PlanDescription::Stage> run;
+                auto flush = [&] {
+                    if(run.empty())
+                        return;
+                    auto output = m_nextBuffer++;
+                    steps.push_back(Step{Kind::Samples, std::move(run), input, input, output, 0.f});
+                    run.clear();
+                    input = output;
+                };
+                for(auto const& node: chain)
+                {
+                    if(isSampleStage(node.type))
+                    {
+                        if(bypassable(node))
+                            flush();
+                        run.push_back(PlanDescription::Stage{node.type, node.params});
+                        if(bypassable(node))
+                            flush();
+                        continue;
+                    }
+                    flush();
+                    auto output = m_nextBuffer++;
+                    if(isBlockStage(node.type))
+                    {
+                        steps.push_back(Step{Kind::Block, {PlanDescription::Stage{node.type, node.params}}, input, input, output, 0.f});
+                    }
+                    else if(node.type == "wetdry")
+                    {
+                        auto first = steps.size();
+                        auto wet = lower(node.paths[0], input);
+                        Step mix{Kind::Mix, mixStages(node), input, wet, output, node.mix};
+                        mix.steps1 = static_cast<unsigned int>(steps.size() - first);
+                        steps.push_back(std::move(mix));
+                    }
+                    else if(node.type == "splitcombine")
+                    {
+                        auto first = steps.size();
+                        auto path0 = lower(node.paths[0], input);
+                        auto second = steps.size();
+                        auto path1 = lower(node.paths[1], input);
+                        Step mix{Kind::Mix, mixStages(node), path0, path1, output, node.mix};
+                        mix.steps0 = static_cast<unsigned int>(second - first);
+                        mix.steps1 = static_cast<unsigned int>(steps.size() - second);
+                        steps.push_back(std::move(mix));
+                    }
+                    else if(node.type == "multiband")
+                    {
+                        Step split{Kind::Split, {PlanDescription::Stage{"crossover", node.params}}, input, input, input, 0.f};
+                        for(std::size_t band = 0; band < node.paths.size(); ++band)
+                            split.buffers.push_back(m_nextBuffer++);
+                        auto bands = split.buffers;
+                        steps.push_back(std::move(split));
+                        Step sum{Kind::Sum, {}, -1, -1, output, 0.f};
+                        for(std::size_t band = 0; band < node.paths.size(); ++band)
+                            sum.buffers.push_back(lower(node.paths[band], bands[band]));
+                        sum.input0 = sum.input1 = sum.buffers.front();
+                        steps.push_back(std::move(sum));
+                    }
+                    input = output;
+                }
+                flush();
+                return input;
+            }
+
+            int buffers() const
+            {
+                return m_nextBuffer;
+            }
+
+            std::vector<Step> steps;
+        private:
+            int m_nextBuffer = 1;
+        };
+
+        /*! Maps the virtual buffers to as few scratch buffers as possible. A buffer is free
+         *  again after its last reader; per-sample runs and mixes may write over an input
+         *  they are the last reader of, block stages always get a separate output. */
+        PlanDescription allocate(Lowering const& lowering)
+        {
+            PlanDescription plan;
+            plan.steps = lowering.steps;
+            if(plan.steps.empty())
+            {
+                plan.steps.push_back(Step{Kind::Copy, {}, PlanDescription::s_input, PlanDescription::s_input, PlanDescription::s_output, 0.f});
+                return plan;
+            }
+            auto inputs = [](Step const& step) {
+                if(step.kind == Kind::Sum)
+                    return step.buffers;
+                std::vector<int> result{step.input0};
+                if(step.kind == Kind::Mix && step.input1 != step.input0)
+                    result.push_back(step.input1);
+                return result;
+            };
+            auto outputs = [](Step const& step) {
+                return step.kind == Kind::Split ? step.buffers : std::vector<int>{step.output};
+            };
+            std::vector<int> lastUse(lowering.buffers(), -1);
+            for(std::size_t i = 0; i < plan.steps.size(); ++i)
+            {
+                for(auto buffer: inputs(plan.steps[i]))
+                    lastUse[buffer] = static_cast<int>(i);
+            }
+            auto result = plan.steps.back().output;
+            std::vector<int> physical(lowering.buffers(), PlanDescription::s_input);
+            physical[result] = PlanDescription::s_output;
+            auto scratch = [&](int buffer) {
+                return buffer != 0 && buffer != result;
+            };
+            std::vector<int> freeBuffers;
+            for(std::size_t i = 0; i < plan.steps.size(); ++i)
+            {
+                auto &step = plan.steps[i];
+                auto stepInputs = inputs(step);
+                // block stages and splits read their input while writing, so never in place
+                auto inPlace = step.kind != Kind::Block && step.kind != Kind::Split;
+                std::vector<int> taken;
+                for(auto output: outputs(step))
+                {
+                    if(output == result)
+                        continue;
+                    auto assigned = -1;
+                    if(inPlace)
+                    {
+                        for(auto buffer: stepInputs)
+                        {
+                            if(scratch(buffer) && lastUse[buffer] == static_cast<int>(i)
+                               && std::find(taken.begin(), taken.end(), physical[buffer]) == taken.end())
+                            {
+                                assigned = physical[buffer];
+                                break;
+                            }
+                        }
+                    }
+                    if(assigned < 0 && !freeBuffers.empty())
+                    {
+                        assigned = freeBuffers.back();
+                        freeBuffers.pop_back();
+                    }
+                    if(assigned < 0)
+                        assigned = static_cast<int>(plan.scratchBuffers++);
+                    physical[output] = assigned;
+                    taken.push_back(assigned);
+                }
+                for(auto buffer: stepInputs)
+                {
+                    if(scratch(buffer) && lastUse[buffer] == static_cast<int>(i)
+                       && std::find(taken.begin(), taken.end(), physical[buffer]) == taken.end()
+                       && std::find(freeBuffers.begin(), freeBuffers.end(), physical[buffer]) == freeBuffers.end())
+                        freeBuffers.push_back(physical[buffer]);
+                }
+                step.input0 = physical[step.input0];
+                step.input1 = physical[step.input1];
+                step.output = physical[step.output];
+                for(auto &buffer: step.buffers)
+                    buffer = physical[buffer];
+            }
+            return plan;
+        }
+
+        std::string cacheKey(std::string const& text)
+        {
+            // FNV-1a, only needs to tell presets apart, not resist anyone
+            std::uint64_t hash = 14695981039346656037ull;
+            for(auto const& part: {std::string(s_compilerVersion), text})
+            {
+                for(auto c: part)
+                {
+                    hash ^= static_cast<unsigned char>(c);
+                    hash *= 1099511628211ull;
+                }
+            }
+            std::ostringstream key;
+            key << std::hex << hash;
+            return key.str();
+        }
+
+        std::string readFile(fs::path const& path)
+        {
+            fs::ifstream s(path, std::ios_base::in | std::ios_base::binary);
+            if(!s)
+                throw Preset::Exception("Error opening " + path.string());
+            return std::string(std::istreambuf_iterator<char>(s), std::istreambuf_iterator<char>());
+        }
+    }
+
+    Preset::Preset(std::string const& filename, std::string const& cacheDirectory)
+        : m_fromCache(false)
+    {
+        auto text = readFile(filename);
+        fs::path cachePath;
+        if(!cacheDirectory.empty())
+        {
+            cachePath = fs::path(cacheDirectory) / (cacheKey(text) + ".json");
+            boost::system::error_code ec;
+            if(fs::is_regular_file(cachePath, ec))
+            {
+                std::string error;
+                auto cached = Json::parse(readFile(cachePath), error);
+                if(PlanDescription::fromJson(cached, m_plan))
+                {
+                    m_fromCache = true;
+                    return;
+                }
+                std::cerr << "Ignoring broken cache entry " << cachePath << std::endl;
+            }
+        }
+        std::string error;
+        auto preset = Json::parse(text, error);
+        if(preset.is_null())
+            throw Exception(filename + ": " + error);
+        m_plan = compile(preset);
+        if(cachePath.empty())
+            return;
+        boost::system::error_code ec;
+        fs::create_directories(cachePath.parent_path(), ec);
+        auto temporary = cachePath;
+        temporary += ".tmp";
+        {
+            fs::ofstream s(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            s << m_plan.toJson().dump();
+            if(!s)
+            {
+                std::cerr << "Error writing preset cache " << temporary << std::endl;
+                return;
+            }
+        }
+        fs::rename(temporary, cachePath, ec);
+        if(ec)
+            std::cerr << "Error writing preset cache " << cachePath << ": " << ec.message() << std::endl;
+    }
+
+    Preset::Preset(Json const& preset)
+        : m_plan(compile(preset))
+        , m_fromCache(false)
+    {}
+
+    PlanDescription const& Preset::getPlan() const
+    {
+        return m_plan;
+    }
+
+    bool Preset::isFromCache() const
+    {
+        return m_fromCache;
+    }
+
+    Plan Preset::instantiate(double sampleRate, unsigned long maxBlockSamples, Meters *meters, Controls *controls) const
+    {
+        return Plan(m_plan, sampleRate, maxBlockSamples, meters, controls);
+    }
+
+    PlanDescription Preset::compile(Json const& preset)
+    {
+        if(!preset.is_object())
+            throw Exception("Preset is not an object");
+        Lowering lowering;
+        lowering.lower(optimize(parseChain(preset["chain"], "chain")), 0);
+        return allocate(lowering);
+    }
+
+    std::string Preset::defaultCacheDirectory()
+    {
+        if(auto *xdg = std::getenv("XDG_CACHE_HOME"))
+            return (fs::path(xdg) / "pedal").string();
+        if(auto *home = std::getenv("HOME"))
+            return (fs::path(home) / ".cache" / "pedal").string();
+        return std::string();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "plan.hpp"
+#include <exception>
+#include <json11.hpp>
+#include <string>
+
+namespace deepness
+{
+    /*! An effect graph loaded from a JSON preset and compiled into a PlanDescription.
+     *
+     *  A preset is an object with a "chain" array. Every element is an object with a "type":
+     *  - per-sample stages like "fuzz", "clip", "gain" {"gain"}, "compress" {"amount"},
+     *    "hipass"/"lopass" {"amount"}, "squareoctavedown" {"octaves"}, "delay", "drone"
+     *  - block stages "octaveup" and "octavedown"
+     *  - "waveshaper" {"expression": "tanh(3 * x)" or "polynomial": [c0, c1, ...] or
+     *    "points": [[x, y], ...], "range", "size", "interpolation": "linear" or "cubic",
+     *    "antialias"}, a transfer curve tabulated when the plan is built
+     *  - "neuralamp" {"model": filename}, a captured amp, see NeuralAmp
+     *  - "reverb" {"decay" s, "size" 0.25 to 2, "damping" Hz, "modulation" ms, "lines": 8 or 16},
+     *    wet only, so usually inside a "wetdry"
+     *  - dynamics block stages "compressor", "limiter" and "gate" {"threshold", "ratio", "knee",
+     *    "attack", "release", "lookahead", "makeup", "range" in dB and ms, "detector": "peak" or
+     *    "rms", "meter": name to publish the gain reduction under}
+     *  - "chain" {"chain": [...]}
+     *  - "wetdry" {"mix", "chain": [...]}, the wet path mixed with the input
+     *  - "splitcombine" {"mix", "paths": [[...], [...]]}, two paths mixed together
+     *  - "multiband" {"frequencies": [Hz, ...], "bands": [[...], ...]}, the input split into
+     *    one more band than there are increasing crossover frequencies, at most 8, each band
+     *    through its chain and the bands summed
+     *
+     *  A "name" on a "gain", "reverb", "wetdry" or "splitcombine" makes its "gain", "decay" and
+     *  "size", or "mix" controls that can change while running, see Controls. Any named stage
+     *  also gets a "bypass" control, and "bypass": true starts it bypassed; such stages run
+     *  as their own step rather than fused with their neighbours.
+     *
+     *  Compiling removes stages that do nothing, fuses runs of per-sample stages into one
+     *  pass, and assigns scratch buffers by liveness so that buffers are reused as soon as
+     *  their last reader has run. The result is cached on disk keyed by the preset text. */
+    class Preset
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+
+        /*! \param cacheDirectory  where compiled plans are kept, empty disables the cache */
+        explicit Preset(std::string const& filename, std::string const& cacheDirectory = defaultCacheDirectory());
+        explicit Preset(json11::Json const& preset);
+        PlanDescription const& getPlan() const;
+        bool isFromCache() const;
+        Plan instantiate(double sampleRate, unsigned long maxBlockSamples = 4096, Meters *meters = nullptr, Controls *controls = nullptr) const;
+
+        static PlanDescription compile(json11::Json const& preset);
+        /*! $XDG_CACHE_HOME/pedal or ~/.cache/pedal */
+        static std::string defaultCacheDirectory();
+    private:
+        PlanDescription m_plan;
+        bool m_fromCache;
+    };
+}
@@ -0,0 +1,79 @@
+#include "realtime.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace deepness
+{
+    std::string setRealtimePriority(int priority)
+    {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        auto err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err)
+            return std::string("Error setting SCHED_FIFO priority: ") + std::strerror(err);
+        return std::string();
+    }
+
+    std::string setCpuAffinity(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(err)
+            return std::string("Error setting cpu affinity: ") + std::strerror(err);
+        return std::string();
+    }
+
+    std::string lockMemory()
+    {
+        // not mlockall(): that would also pin shared file mappings like the looper's backing
+        // file, which is meant to be paged, and with MCL_FUTURE everything mapped later
+        std::ifstream maps("/proc/self/maps");
+        if(!maps)
+            return "Error locking memory: can't read /proc/self/maps";
+        std::string line;
+        std::string error;
+        while(std::getline(maps, line))
+        {
+            std::istringstream fields(line);
+            std::uintptr_t begin, end;
+            char dash;
+            std::string permissions, offset, device, path;
+            unsigned long inode;
+            if(!(fields >> std::hex >> begin >> dash >> end >> permissions >> offset >> device >> std::dec >> inode))
+                continue;
+            fields >> path;
+            auto shared = permissions.size() > 3 && permissions[3] == 's';
+            auto inaccessible = permissions.compare(0, 3, "---") == 0;
+            if((shared && inode != 0) || inaccessible || path == "[vsyscall]")
+                continue;
+            if(mlock(reinterpret_cast<void*>(begin), end - begin) && error.empty())
+                error = std::string("Error locking memory: ") + std::strerror(errno);
+        }
+        return error;
+    }
+
+    std::string setBackgroundPriority()
+    {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        auto err = pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+        if(err)
+            return std::string("Error setting SCHED_BATCH: ") + std::strerror(err);
+        // nice values are per thread on Linux
+        if(setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19))
+            return std::string("Error setting nice level: ") + std::strerror(errno);
+        return std::string();
+    }
+}
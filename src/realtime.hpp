@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace deepness
+{
+    /*! Helpers to make the calling thread fit for audio work. They report failure instead of
+     *  throwing because missing privileges should degrade the latency, not stop the pedal.
+     *  \returns an empty string on success, otherwise what went wrong. */
+    std::string setRealtimePriority(int priority);
+    /*! Pins the calling thread to \a cpu. */
+    std::string setCpuAffinity(int cpu);
+    /*! Locks the memory currently mapped by the process so the audio thread never waits for
+     *  a page fault: code, heap, stacks and anonymous buffers, but not shared file mappings
+     *  such as a file-backed MappedBuffer. Call it once the graph is built, from the audio
+     *  thread so its stack is included. */
+    std::string lockMemory();
+    /*! Moves the calling thread to SCHED_BATCH at the lowest nice level, for housekeeping
+     *  threads like disk writers that must never compete with the audio thread. */
+    std::string setBackgroundPriority();
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "effects.hpp"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace deepness
+{
+    /*! Runs a transform on blocks of exactly Quantum samples, whatever the backend hands in.
+     *
+     *  If the backend's block size is a whole number of quanta the blocks are processed in
+     *  place without added latency, otherwise a FIFO of one quantum is used from the start:
+     *  input is collected until a quantum is full and the previous quantum's output is played
+     *  meanwhile, which costs exactly Quantum samples of latency. A backend that later hands
+     *  in an odd block after all switches to the FIFO for good; the delay can't jump without
+     *  a discontinuity, so the last quantum is played backwards fading out and the first one
+     *  through the FIFO fades in. The FIFO belongs to the audio thread, so it needs neither
+     *  locks nor atomics.
+     *
+     *  Quantum is a compile time constant only here: the transform is still a SoundTransform
+     *  called with a runtime size, which is always Quantum, so its kernels aren't compiled for
+     *  that size. */
+    template<unsigned long Quantum>
+    class Reblocker
+    {
+    public:
+        static constexpr unsigned long s_quantum = Quantum;
+
+        /*! \param blockSamples  block size the backend was opened with */
+        Reblocker(SoundTransform transform, unsigned long blockSamples)
+            : m_transform(std::move(transform))
+            , m_aligned(blockSamples % Quantum == 0)
+            , m_fadeIn(false)
+            , m_fill(0)
+        {
+            m_input.fill(0.f);
+            m_output.fill(0.f);
+        }
+
+        void operator()(const float *in, float *out, unsigned long samples)
+        {
+            if(m_aligned && samples % Quantum == 0)
+            {
+                for(decltype(samples) i = 0; i < samples; i += Quantum)
+                    m_transform(in + i, out + i, Quantum);
+                // kept to fade out from, should the FIFO take over
+                if(samples)
+                    std::copy_n(out + samples - Quantum, Quantum, m_output.data());
+                return;
+            }
+            if(m_aligned)
+            {
+                m_aligned = false;
+                m_fadeIn = true;
+                std::reverse(m_output.begin(), m_output.end());
+                for(unsigned long i = 0; i < Quantum; ++i)
+                    m_output[i] *= static_cast<float>(Quantum - i) / Quantum;
+            }
+            while(samples)
+            {
+                auto count = std::min(samples, Quantum - m_fill);
+                std::copy_n(in, count, m_input.data() + m_fill);
+                std::copy_n(m_output.data() + m_fill, count, out);
+                m_fill += count;
+                in += count;
+                out += count;
+                samples -= count;
+                if(m_fill == Quantum)
+                {
+                    m_transform(m_input.data(), m_output.data(), Quantum);
+                    if(m_fadeIn)
+                    {
+                        for(unsigned long i = 0; i < Quantum; ++i)
+                            m_output[i] *= static_cast<float>(i + 1) / Quantum;
+                        m_fadeIn = false;
+                    }
+                    m_fill = 0;
+                }
+            }
+        }
+
+        /*! \returns the samples of delay added, 0 while the blocks are whole quanta */
+        unsigned long getLatency() const
+        {
+            return m_aligned ? 0 : Quantum;
+        }
+    private:
+        SoundTransform m_transform;
+        bool m_aligned;
+        bool m_fadeIn;
+        unsigned long m_fill;
+        std::array<float, Quantum> m_input;
+        std::array<float, Quantum> m_output;
+    };
+
+    /*! \returns \a transform re-blocked to \a quantum samples, which must be 32, 64 or 128.
+     *  0 returns \a transform unchanged.
+     *  \param blockSamples  block size the backend was opened with */
+    inline SoundTransform reblock(unsigned long quantum, SoundTransform transform, unsigned long blockSamples)
+    {
+        switch(quantum)
+        {
+        case 0:
+            return transform;
+        case 32:
+            return Reblocker<32>(std::move(transform), blockSamples);
+        case 64:
+            return Reblocker<64>(std::move(transform), blockSamples);
+        case 128:
+            return Reblocker<128>(std::move(transform), blockSamples);
+        }
+        throw std::invalid_argument("Unsupported quantum " + std::to_string(quantum) + ", use 32, 64 or 128");
+    }
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "denormal.hpp"
+#include "mappedbuffer.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+namespace deepness
+{
+    /*! Feedback delay network reverb, producing only the wet signal.
+     *
+     *  All lines share one arena laid out frame by frame: the values of every line for one
+     *  sample sit next to each other, so writing, damping, mixing and injecting the input
+     *  work on one vector of Lines floats per sample. Only the reads, whose delays differ per
+     *  line, gather from different frames. The feedback matrix is a normalised Hadamard
+     *  matrix applied as a fast Walsh-Hadamard transform. Every line has a one-pole lowpass
+     *  for damping and a slowly modulated fractional read tap to smear out the modes.
+     *
+     *  Decay and size may be changed from any thread while running; size is smoothed to keep
+     *  the taps from jumping. */
+    template<unsigned int Lines>
+    class Reverb
+    {
+        static_assert(Lines >= 2 && (Lines & (Lines - 1)) == 0, "Hadamard mixing needs a power of two lines");
+    public:
+        struct Settings
+        {
+            /*! seconds to decay by 60 dB */
+            float decay = 2.f;
+            /*! scales all delay lengths, 0.25 to s_maxSize */
+            float size = 1.f;
+            /*! lowpass cutoff in the feedback path, Hz */
+            float damping = 6000.f;
+            /*! peak deviation of the read taps, ms, 0 or more */
+            float modulation = 0.3f;
+        };
+        static constexpr float s_maxSize = 2.f;
+
+        Reverb(double sampleRate, Settings settings)
+            : m_sampleRate(static_cast<float>(sampleRate))
+            , m_decay(settings.decay)
+            , m_targetSize(clampSize(settings.size))
+            , m_size(clampSize(settings.size))
+            , m_appliedDecay(-1.f)
+            , m_appliedSize(-1.f)
+            , m_write(0)
+            , m_depth(std::max(0.f, settings.modulation) * 0.001f * m_sampleRate)
+        {
+            // spread geometrically over 20 to 80 ms, each a prime number of samples
+            for(unsigned int line = 0; line < Lines; ++line)
+            {
+                auto length = static_cast<unsigned int>(0.02f * m_sampleRate * std::pow(4.f, line / (Lines - 1.f)));
+                while(!isPrime(length))
+                    ++length;
+                m_base[line] = static_cast<float>(length);
+            }
+            // the taps swing between 0 and 2 * depth past the base delay, and interpolate
+            // with the sample one further back
+            auto longest = m_base[Lines - 1] * s_maxSize + 2.f * m_depth + 2.f;
+            std::size_t frames = 1;
+            while(frames < longest)
+                frames *= 2;
+            m_mask = frames - 1;
+            m_arena = MappedBuffer(frames * Lines);
+            auto damping = 1.f - std::exp(-2.f * static_cast<float>(M_PI) * std::min(settings.damping, 0.45f * m_sampleRate) / m_sampleRate);
+            for(unsigned int line = 0; line < Lines; ++line)
+            {
+                m_damping[line] = damping;
+                m_lowpass[line] = 0.f;
+                // a different rate and phase per line, as a rotating phasor
+                auto rate = 2.f * static_cast<float>(M_PI) * (0.3f + 0.6f * line / Lines) / m_sampleRate;
+                m_rotateCos[line] = std::cos(rate);
+                m_rotateSin[line] = std::sin(rate);
+                auto phase = 2.f * static_cast<float>(M_PI) * line / Lines;
+                m_phaseCos[line] = std::cos(phase);
+                m_phaseSin[line] = std::sin(phase);
+                m_sign[line] = line % 2 ? -1.f : 1.f;
+            }
+            // the size smoothing settles within about 50 ms
+            m_sizeSmoothing = 1.f - std::exp(-1.f / (0.05f * m_sampleRate));
+        }
+        Reverb(Reverb const&) = delete;
+        Reverb &operator=(Reverb const&) = delete;
+
+        void setDecay(float seconds)
+        {
+            m_decay.store(std::max(seconds, 0.01f), std::memory_order_relaxed);
+        }
+
+        void setSize(float size)
+        {
+            m_targetSize.store(clampSize(size), std::memory_order_relaxed);
+        }
+
+        void operator()(const float *in, float *out, unsigned long samples)
+        {
+            auto targetSize = m_targetSize.load(std::memory_order_relaxed);
+            updateGains(targetSize);
+            auto *arena = m_arena.data();
+            const auto inputGain = 1.f / std::sqrt(static_cast<float>(Lines));
+            const auto outputGain = 1.f / std::sqrt(static_cast<float>(Lines));
+            const auto depth = m_depth;
+            auto size = m_size;
+            alignas(32) float frame[Lines];
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                size += m_sizeSmoothing * (targetSize - size);
+                // fractional taps behind the write position
+                for(unsigned int line = 0; line < Lines; ++line)
+                {
+                    auto delay = m_base[line] * size + depth * (1.f + m_phaseSin[line]);
+                    auto whole = static_cast<std::size_t>(delay);
+                    auto fraction = delay - whole;
+                    auto a = arena[((m_write - whole) & m_mask) * Lines + line];
+                    auto b = arena[((m_write - whole - 1) & m_mask) * Lines + line];
+                    frame[line] = a + fraction * (b - a);
+                }
+                auto wet = 0.f;
+                for(unsigned int line = 0; line < Lines; ++line)
+                    wet += m_sign[line] * frame[line];
+                out[i] = wet * outputGain;
+                for(unsigned int line = 0; line < Lines; ++line)
+                {
+                    m_lowpass[line] = flushDenormal(m_lowpass[line] + m_damping[line] * (frame[line] - m_lowpass[line]));
+                    frame[line] = m_lowpass[line] * m_gain[line];
+                }
+                hadamard(frame);
+                auto *write = arena + (m_write & m_mask) * Lines;
+                auto input = in[i] * inputGain;
+                for(unsigned int line = 0; line < Lines; ++line)
+                    write[line] = flushDenormal(frame[line] + m_sign[line] * input);
+                ++m_write;
+                for(unsigned int line = 0; line < Lines; ++line)
+                {
+                    auto c = m_phaseCos[line];
+                    auto s = m_phaseSin[line];
+                    m_phaseCos[line] = c * m_rotateCos[line] - s * m_rotateSin[line];
+                    m_phaseSin[line] = s * m_rotateCos[line] + c * m_rotateSin[line];
+                }
+            }
+            m_size = size;
+            // keep the phasors on the unit circle against rounding drift
+            for(unsigned int line = 0; line < Lines; ++line)
+            {
+                auto norm = 1.f / std::sqrt(m_phaseCos[line] * m_phaseCos[line] + m_phaseSin[line] * m_phaseSin[line]);
+                m_phaseCos[line] *= norm;
+                m_phaseSin[line] *= norm;
+            }
+        }
+    private:
+        static float clampSize(float size)
+        {
+            return std::min(std::max(size, 0.25f), s_maxSize);
+        }
+
+        static bool isPrime(unsigned int value)
+        {
+            if(value < 2)
+                return false;
+            for(unsigned int divisor = 2; divisor * divisor <= value; ++divisor)
+            {
+                if(value % divisor == 0)
+                    return false;
+            }
+            return true;
+        }
+
+        /*! Per block: the gain that makes each line lose 60 dB over the decay time. */
+        void updateGains(float targetSize)
+        {
+            auto decay = m_decay.load(std::memory_order_relaxed);
+            if(decay == m_appliedDecay && targetSize == m_appliedSize)
+                return;
+            m_appliedDecay = decay;
+            m_appliedSize = targetSize;
+            for(unsigned int line = 0; line < Lines; ++line)
+                m_gain[line] = std::pow(10.f, -3.f * m_base[line] * targetSize / (decay * m_sampleRate));
+        }
+
+        static void hadamard(float *frame)
+        {
+            for(unsigned int width = 1; width < Lines; width *= 2)
+            {
+                for(unsigned int start = 0; start < Lines; start += 2 * width)
+                {
+                    for(unsigned int line = start; line < start + width; ++line)
+                    {
+                        auto a = frame[line];
+                        auto b = frame[line + width];
+                        frame[line] = a + b;
+                        frame[line + width] = a - b;
+                    }
+                }
+            }
+            const auto scale = 1.f / std::sqrt(static_cast<float>(Lines));
+            for(unsigned int line = 0; line < Lines; ++line)
+                frame[line] *= scale;
+        }
+
+        float m_sampleRate;
+        std::atomic<float> m_decay;
+        std::atomic<float> m_targetSize;
+        float m_size;
+        float m_appliedDecay;
+        float m_appliedSize;
+        MappedBuffer m_arena;
+        std::size_t m_mask;
+        std::size_t m_write;
+        float m_depth;
+        float m_sizeSmoothing;
+        std::array<float, Lines> m_base;
+        std::array<float, Lines> m_gain;
+        std::array<float, Lines> m_damping;
+        std::array<float, Lines> m_lowpass;
+        std::array<float, Lines> m_rotateCos;
+        std::array<float, Lines> m_rotateSin;
+        std::array<float, Lines> m_phaseCos;
+        std::array<float, Lines> m_phaseSin;
+        std::array<float, Lines> m_sign;
+    };
+
+    template<unsigned int Lines>
+    constexpr float Reverb<Lines>::s_maxSize;
+}
@@ -0,0 +1,180 @@
+#include "sessionrecorder.hpp"
+#include "realtime.hpp"
+#include "soundwriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace deepness
+{
+    namespace
+    {
+        constexpr unsigned int s_channels = 2;
+        // frames written per call, and the least the writer waits for while recording
+        constexpr std::uint64_t s_chunkFrames = 1 << 15;
+        constexpr auto s_pollInterval = std::chrono::milliseconds(20);
+        constexpr double s_reserveSeconds = 60.;
+
+        std::uint64_t roundUp(std::uint64_t frames)
+        {
+            std::uint64_t size = 1;
+            while(size < frames)
+                size *= 2;
+            return size;
+        }
+    }
+
+    SessionRecorder::SessionRecorder(double sampleRate, double bufferSeconds)
+        : m_sampleRate(sampleRate)
+        , m_capacity(roundUp(static_cast<std::uint64_t>(std::max(bufferSeconds * sampleRate, static_cast<double>(s_chunkFrames)))))
+        , m_mask(m_capacity - 1)
+        , m_head(0)
+        , m_tail(0)
+        , m_requested(false)
+        , m_pushing(false)
+        , m_frames(0)
+        , m_droppedBlocks(0)
+        , m_droppedFrames(0)
+    {
+        m_ring = MappedBuffer(m_capacity * s_channels);
+    }
+
+    SessionRecorder::~SessionRecorder()
+    {
+        stop();
+    }
+
+    void SessionRecorder::operator()(const float *dry, const float *wet, unsigned long samples)
+    {
+        // sequentially consistent against stop() storing m_requested and loading m_pushing
+        m_pushing.store(true);
+        if(!m_requested.load())
+        {
+            m_pushing.store(false, std::memory_order_release);
+            return;
+        }
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if(m_capacity - (tail - m_head.load(std::memory_order_acquire)) < samples)
+        {
+            m_droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+            m_droppedFrames.fetch_add(samples, std::memory_order_relaxed);
+            m_pushing.store(false, std::memory_order_release);
+            return;
+        }
+        auto *ring = m_ring.data();
+        for(decltype(samples) i = 0; i < samples; ++i)
+        {
+            auto *frame = ring + ((tail + i) & m_mask) * s_channels;
+            frame[0] = dry[i];
+            frame[1] = wet[i];
+        }
+        m_tail.store(tail + samples, std::memory_order_release);
+        m_pushing.store(false, std::memory_order_release);
+    }
+
+    bool SessionRecorder::start(std::string const& filename)
+    {
+        std::lock_guard<std::mutex> control(m_controlMutex);
+        if(m_thread.joinable())
+            return false;
+        SoundWriter writer(filename, m_sampleRate, s_channels);
+        // the audio thread won't push again until m_requested is set
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_frames = 0;
+        m_droppedBlocks = 0;
+        m_droppedFrames = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_filename = filename;
+            m_error.clear();
+        }
+        m_requested.store(true);
+        m_thread = std::thread(&SessionRecorder::writerThread, this, std::move(writer));
+        return true;
+    }
+
+    void SessionRecorder::stop()
+    {
+        std::lock_guard<std::mutex> control(m_controlMutex);
+        if(!m_thread.joinable())
+            return;
+        m_requested.store(false);
+        m_thread.join();
+    }
+
+    SessionRecorder::Status SessionRecorder::getStatus() const
+    {
+        Status status;
+        status.recording = m_requested.load();
+        status.frames = m_frames.load();
+        status.droppedBlocks = m_droppedBlocks.load();
+        status.droppedFrames = m_droppedFrames.load();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        status.filename = m_filename;
+        status.error = m_error;
+        return status;
+    }
+
+    std::uint64_t SessionRecorder::pending() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_relaxed);
+    }
+
+    void SessionRecorder::writerThread(SoundWriter writer)
+    {
+        auto error = setBackgroundPriority();
+        if(!error.empty())
+            std::cerr << error << std::endl;
+        auto reserveFrames = static_cast<unsigned long>(s_reserveSeconds * m_sampleRate);
+        std::uint64_t reserved = writer.reserve(reserveFrames) ? reserveFrames : 0;
+        std::uint64_t reportedDrops = 0;
+        auto failed = false;
+        while(true)
+        {
+            // once the audio thread is seen outside a push after the stop, what's left is final
+            auto draining = !m_requested.load() && !m_pushing.load();
+            auto available = pending();
+            if(!draining && available < s_chunkFrames)
+            {
+                std::this_thread::sleep_for(s_pollInterval);
+                continue;
+            }
+            while(available)
+            {
+                auto head = m_head.load(std::memory_order_relaxed);
+                // contiguous up to the end of the ring
+                auto count = std::min({available, s_chunkFrames, m_capacity - (head & m_mask)});
+                if(!failed)
+                {
+                    try
+                    {
+                        writer.write(m_ring.data() + (head & m_mask) * s_channels, count);
+                        m_frames.fetch_add(count, std::memory_order_relaxed);
+                    }
+                    catch(SoundWriter::Exception const& e)
+                    {
+                        // keep draining so the audio thread doesn't notice
+                        failed = true;
+                        std::cerr << "Session recorder: " << e.what() << std::endl;
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_error = e.what();
+                    }
+                }
+                m_head.store(head + count, std::memory_order_release);
+                available -= count;
+            }
+            auto frames = m_frames.load(std::memory_order_relaxed);
+            if(reserved && frames + reserveFrames / 2 > reserved && writer.reserve(reserveFrames))
+                reserved += reserveFrames;
+            auto drops = m_droppedBlocks.load(std::memory_order_relaxed);
+            if(drops != reportedDrops)
+            {
+                std::cerr << "Session recorder dropped " << drops - reportedDrops << " blocks, the disk can't keep up" << std::endl;
+                reportedDrops = drops;
+            }
+            if(draining)
+                break;
+        }
+    }
+}
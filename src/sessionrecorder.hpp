@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mappedbuffer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace deepness
+{
+    class SoundWriter;
+
+    /*! Records the dry input and the wet output of the pedal to a stereo sound file, dry on
+     *  the left channel and wet on the right.
+     *
+     *  The audio thread copies every block into a lock-free ring allocated up front. A writer
+     *  thread at background priority drains the ring in large chunks through libsndfile and
+     *  preallocates the file ahead of the data. If the ring is ever too full to take a block,
+     *  the whole block is dropped and counted rather than waiting for the disk. */
+    class SessionRecorder
+    {
+    public:
+        struct Status
+        {
+            bool recording;
+            std::string filename;
+            std::uint64_t frames;
+            std::uint64_t droppedBlocks;
+            std::uint64_t droppedFrames;
+            /*! the last write error, empty if none */
+            std::string error;
+        };
+
+        /*! \param bufferSeconds  how long the disk may stall before blocks are dropped */
+        SessionRecorder(double sampleRate, double bufferSeconds = 10.);
+        ~SessionRecorder();
+        SessionRecorder(SessionRecorder const&) = delete;
+        SessionRecorder &operator=(SessionRecorder const&) = delete;
+
+        /*! Audio thread. */
+        void operator()(const float *dry, const float *wet, unsigned long samples);
+
+        /*! Starts recording to \a filename, ".flac" for FLAC, otherwise WAV.
+         *  \returns false if a recording is already running
+         *  \throws SoundWriter::Exception if the file can't be created */
+        bool start(std::string const& filename);
+        /*! Stops recording and waits until everything is on disk. */
+        void stop();
+        Status getStatus() const;
+    private:
+        void writerThread(SoundWriter writer);
+        std::uint64_t pending() const;
+
+        double m_sampleRate;
+        MappedBuffer m_ring;
+        std::uint64_t m_capacity;
+        std::uint64_t m_mask;
+        alignas(64) std::atomic<std::uint64_t> m_head;
+        alignas(64) std::atomic<std::uint64_t> m_tail;
+        // set by start()/stop(); m_pushing is set while the audio thread may touch the ring,
+        // so once stop() cleared m_requested and m_pushing is seen clear, no more frames come
+        std::atomic<bool> m_requested;
+        std::atomic<bool> m_pushing;
+        std::atomic<std::uint64_t> m_frames;
+        std::atomic<std::uint64_t> m_droppedBlocks;
+        std::atomic<std::uint64_t> m_droppedFrames;
+        std::thread m_thread;
+        std::mutex m_controlMutex;
+        // guards the filename and the error
+        mutable std::mutex m_mutex;
+        std::string m_filename;
+        std::string m_error;
+    };
+}
@@ -0,0 +1,76 @@
+#include "soundreader.hpp"
+#include <sndfile.h>
+
+namespace deepness
+{
+    SoundReader::SoundReader(std::string const& filename)
+        : m_handle(nullptr)
+    {
+        SF_INFO info = {0};
+        m_handle = sf_open(filename.c_str(), SFM_READ, &info);
+        if(!m_handle)
+            throw Exception(filename + ": " + sf_strerror(nullptr));
+        m_channels = info.channels;
+        m_sampleRate = info.samplerate;
+        m_frames = static_cast<unsigned long long>(info.frames);
+    }
+
+    SoundReader::SoundReader() noexcept
+    : m_handle(nullptr)
+    , m_channels(1)
+    , m_sampleRate(0.)
+    , m_frames(0)
+    {}
+
+    SoundReader::SoundReader(SoundReader &&other) noexcept
+    : m_handle(nullptr)
+    {
+        *this = std::move(other);
+    }
+
+    SoundReader &SoundReader::operator=(SoundReader &&other) noexcept
+    {
+        if(m_handle)
+            sf_close(m_handle);
+        m_handle = other.m_handle;
+        m_channels = other.m_channels;
+        m_sampleRate = other.m_sampleRate;
+        m_frames = other.m_frames;
+        m_interleaved = std::move(other.m_interleaved);
+        other.m_handle = nullptr;
+        return *this;
+    }
+
+    SoundReader::~SoundReader() noexcept
+    {
+        if(m_handle)
+            sf_close(m_handle);
+    }
+
+    unsigned long SoundReader::read(float *buffer, unsigned long samples)
+    {
+        if(m_channels == 1)
+            return static_cast<unsigned long>(sf_readf_float(m_handle, buffer, samples));
+        m_interleaved.resize(samples * m_channels);
+        auto count = static_cast<unsigned long>(sf_readf_float(m_handle, m_interleaved.data(), samples));
+        auto scale = 1.f / m_channels;
+        for(decltype(count) i = 0; i < count; ++i)
+        {
+            auto sum = 0.f;
+            for(auto channel = 0; channel < m_channels; ++channel)
+                sum += m_interleaved[i * m_channels + channel];
+            buffer[i] = sum * scale;
+        }
+        return count;
+    }
+
+    double SoundReader::getSampleRate() const noexcept
+    {
+        return m_sampleRate;
+    }
+
+    unsigned long long SoundReader::getFrames() const noexcept
+    {
+        return m_frames;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <exception>
+#include <vector>
+
+typedef struct SNDFILE_tag SNDFILE;
+
+namespace deepness
+{
+    /*! Reads a sound file once from start to end, mixed down to mono. */
+    class SoundReader
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+
+        SoundReader() noexcept;
+        explicit SoundReader(std::string const& filename);
+        SoundReader(SoundReader &&other) noexcept;
+        SoundReader &operator=(SoundReader &&other) noexcept;
+        ~SoundReader() noexcept;
+        SoundReader(SoundReader const&) = delete;
+        SoundReader &operator=(SoundReader const&) = delete;
+        /*! \returns the number of samples read, less than \a samples only at the end of the file */
+        unsigned long read(float *buffer, unsigned long samples);
+        double getSampleRate() const noexcept;
+        unsigned long long getFrames() const noexcept;
+    private:
+        SNDFILE *m_handle;
+        int m_channels;
+        double m_sampleRate;
+        unsigned long long m_frames;
+        std::vector<float> m_interleaved;
+    };
+}
@@ -0,0 +1,114 @@
+#include "soundwriter.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sndfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace deepness
+{
+    SoundWriter::SoundWriter(std::string const& filename, double sampleRate, int channels)
+        : m_handle(nullptr)
+        , m_fd(-1)
+        , m_channels(channels)
+    {
+        SF_INFO info = {0};
+        info.samplerate = static_cast<int>(sampleRate);
+        info.channels = channels;
+        if(boost::iends_with(filename, ".flac"))
+        {
+            info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+            // compressed frames are smaller, so this is an upper bound
+            m_bytesPerFrame = 3 * channels;
+        }
+        else
+        {
+            // float WAV passes the 4 GB RIFF limit after about 3 hours of stereo
+            info.format = SF_FORMAT_RF64 | SF_FORMAT_FLOAT;
+            m_bytesPerFrame = 4 * channels;
+        }
+        // opened here rather than by libsndfile to keep the descriptor for fallocate
+        m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(m_fd < 0)
+            throw Exception("Error opening " + filename + ": " + std::strerror(errno));
+        m_handle = sf_open_fd(m_fd, SFM_WRITE, &info, SF_FALSE);
+        if(!m_handle)
+        {
+            ::close(m_fd);
+            throw Exception(sf_strerror(nullptr));
+        }
+        // written as plain WAV, and only turned into RF64 if it outgrows RIFF
+        if((info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_RF64)
+            sf_command(m_handle, SFC_RF64_AUTO_DOWNGRADE, nullptr, SF_TRUE);
+        // integer formats would otherwise wrap around on samples beyond full scale
+        if((info.format & SF_FORMAT_SUBMASK) != SF_FORMAT_FLOAT)
+            sf_command(m_handle, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+    }
+
+    SoundWriter::SoundWriter() noexcept
+    : m_handle(nullptr)
+    , m_fd(-1)
+    , m_channels(1)
+    , m_bytesPerFrame(4)
+    {}
+
+    SoundWriter::SoundWriter(SoundWriter &&other) noexcept
+    : m_handle(nullptr)
+    , m_fd(-1)
+    , m_channels(1)
+    , m_bytesPerFrame(4)
+    {
+        *this = std::move(other);
+    }
+
+    SoundWriter &SoundWriter::operator=(SoundWriter &&other) noexcept
+    {
+        if(m_handle)
+            sf_close(m_handle);
+        if(m_fd >= 0)
+            ::close(m_fd);
+        m_handle = other.m_handle;
+        m_fd = other.m_fd;
+        m_channels = other.m_channels;
+        m_bytesPerFrame = other.m_bytesPerFrame;
+        other.m_handle = nullptr;
+        other.m_fd = -1;
+        return *this;
+    }
+
+    SoundWriter::~SoundWriter() noexcept
+    {
+        if(m_handle)
+            sf_close(m_handle);
+        if(m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    void SoundWriter::write(const float *buffer, unsigned long frames)
+    {
+        while(frames)
+        {
+            auto count = sf_writef_float(m_handle, buffer, frames);
+            if(count <= 0)
+                throw Exception(std::string("Error writing sound file: ") + sf_strerror(m_handle));
+            buffer += count * m_channels;
+            frames -= count;
+        }
+    }
+
+    bool SoundWriter::reserve(unsigned long frames)
+    {
+        struct stat info;
+        if(m_fd < 0 || ::fstat(m_fd, &info))
+            return false;
+        // keep the size so the preallocated space isn't part of the file until written
+        return ::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, info.st_size, static_cast<off_t>(frames) * m_bytesPerFrame) == 0;
+    }
+
+    SoundWriter::operator bool() const noexcept
+    {
+        return m_handle != nullptr;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <exception>
+
+typedef struct SNDFILE_tag SNDFILE;
+
+namespace deepness
+{
+    /*! Writes interleaved float frames to a sound file. The container is picked from the
+     *  extension: ".flac" gives 24 bit FLAC, anything else 32 bit float WAV, which
+     *  becomes RF64 once it passes the 4 GB RIFF limit. */
+    class SoundWriter
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+
+        SoundWriter() noexcept;
+        SoundWriter(std::string const& filename, double sampleRate, int channels = 1);
+        SoundWriter(SoundWriter &&other) noexcept;
+        SoundWriter &operator=(SoundWriter &&other) noexcept;
+        ~SoundWriter() noexcept;
+        SoundWriter(SoundWriter const&) = delete;
+        SoundWriter &operator=(SoundWriter const&) = delete;
+        /*! \param frames  number of frames, i.e. samples per channel */
+        void write(const float *buffer, unsigned long frames);
+        /*! Preallocates disk space for \a frames more frames past the end of the file, so long
+         *  recordings stay sequential on disk and don't fail halfway for lack of space.
+         *  \returns false if the filesystem doesn't support it */
+        bool reserve(unsigned long frames);
+        explicit operator bool() const noexcept;
+    private:
+        SNDFILE *m_handle;
+        int m_fd;
+        int m_channels;
+        int m_bytesPerFrame;
+    };
+}
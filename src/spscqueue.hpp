@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace deepness
+{
+    /*! Bounded lock-free queue for one producer and one consumer thread. Everything is
+     *  allocated up front, so both ends are safe to use on the audio thread. */
+    template<typename T>
+    class SpscQueue
+    {
+    public:
+        /*! \param capacity  rounded up to a power of two */
+        explicit SpscQueue(std::size_t capacity)
+            : m_items(roundUp(capacity))
+            , m_mask(m_items.size() - 1)
+            , m_head(0)
+            , m_tail(0)
+        {}
+        SpscQueue(SpscQueue const&) = delete;
+        SpscQueue &operator=(SpscQueue const&) = delete;
+
+        /*! \returns false if the queue is full */
+        bool push(T const& item)
+        {
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            if(tail - m_head.load(std::memory_order_acquire) == m_items.size())
+                return false;
+            m_items[tail & m_mask] = item;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /*! \returns the oldest item, or nullptr if the queue is empty. Only valid until pop() */
+        T *front()
+        {
+            auto head = m_head.load(std::memory_order_relaxed);
+            if(head == m_tail.load(std::memory_order_acquire))
+                return nullptr;
+            return &m_items[head & m_mask];
+        }
+
+        void pop()
+        {
+            m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool pop(T &item)
+        {
+            auto *next = front();
+            if(!next)
+                return false;
+            item = *next;
+            pop();
+            return true;
+        }
+
+        bool empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        std::size_t capacity() const
+        {
+            return m_items.size();
+        }
+    private:
+        static std::size_t roundUp(std::size_t capacity)
+        {
+            std::size_t size = 1;
+            while(size < capacity)
+                size *= 2;
+            return size;
+        }
+
+        std::vector<T> m_items;
+        std::size_t m_mask;
+        alignas(64) std::atomic<std::size_t> m_head;
+        alignas(64) std::atomic<std::size_t> m_tail;
+    };
+}
@@ -0,0 +1,112 @@
+#include "threadpool.hpp"
+#include <algorithm>
+
+namespace deepness
+{
+    ThreadPool::ThreadPool(unsigned int threads)
+        : m_next(0)
+        , m_pending(0)
+        , m_running(true)
+    {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for(decltype(threads) i = 0; i < threads; ++i)
+            m_workers.push_back(std::make_unique<Worker>());
+        for(decltype(threads) i = 0; i < threads; ++i)
+            m_threads.emplace_back([this, i] {
+                    run(i);
+                });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_taskAvailable.notify_all();
+        for(auto &thread: m_threads)
+            thread.join();
+    }
+
+    void ThreadPool::submit(Task task)
+    {
+        auto &worker = *m_workers[m_next++ % m_workers.size()];
+        {
+            // pushed under m_mutex so a worker can't miss it between its check and its wait
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_pending;
+            std::lock_guard<std::mutex> workerLock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        m_taskAvailable.notify_all();
+    }
+
+    void ThreadPool::wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_pending == 0; });
+    }
+
+    unsigned int ThreadPool::size() const
+    {
+        return static_cast<unsigned int>(m_workers.size());
+    }
+
+    bool ThreadPool::take(unsigned int index, Task &task)
+    {
+        {
+            auto &own = *m_workers[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for(std::size_t offset = 1; offset < m_workers.size(); ++offset)
+        {
+            auto &victim = *m_workers[(index + offset) % m_workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::queued()
+    {
+        for(auto &worker: m_workers)
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            if(!worker->tasks.empty())
+                return true;
+        }
+        return false;
+    }
+
+    void ThreadPool::run(unsigned int index)
+    {
+        while(true)
+        {
+            Task task;
+            if(take(index, task))
+            {
+                task(index);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(--m_pending == 0)
+                    m_idle.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(!m_running)
+                return;
+            m_taskAvailable.wait(lock, [this] { return !m_running || queued(); });
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace deepness
+{
+    /*! Fixed set of worker threads, each with its own task deque. A worker takes its newest
+     *  task first and steals the oldest task of another worker once its own deque is empty,
+     *  so uneven tasks (long and short files) still keep every core busy. */
+    class ThreadPool
+    {
+    public:
+        /*! \param worker  index of the worker running the task */
+        using Task = std::function<void (unsigned int worker)>;
+
+        /*! \param threads  0 uses one per hardware thread */
+        explicit ThreadPool(unsigned int threads = 0);
+        ~ThreadPool();
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool &operator=(ThreadPool const&) = delete;
+        /*! Tasks are spread round robin over the workers. */
+        void submit(Task task);
+        /*! Blocks until all submitted tasks have finished. */
+        void wait();
+        unsigned int size() const;
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+        void run(unsigned int index);
+        bool take(unsigned int index, Task &task);
+        /*! Whether any worker has a task, called with m_mutex held. */
+        bool queued();
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+        std::atomic<unsigned int> m_next;
+        std::mutex m_mutex;
+        std::condition_variable m_taskAvailable;
+        std::condition_variable m_idle;
+        std::size_t m_pending;
+        bool m_running;
+    };
+}
@@ -0,0 +1,399 @@
+#include "waveshaper.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+
+namespace deepness
+{
+    namespace
+    {
+        // below this input step the antialiased quotient loses its float precision
+        constexpr float s_antialiasEpsilon = 1e-3f;
+
+        /*! Recursive descent over the expression, building closures as it goes. */
+        class ExpressionParser
+        {
+        public:
+            using Curve = Waveshaper::Curve;
+
+            explicit ExpressionParser(std::string const& text)
+                : m_text(text)
+                , m_pos(0)
+            {}
+
+            Curve parse()
+            {
+                auto result = sum();
+                skipSpace();
+                if(m_pos != m_text.size())
+                    fail("unexpected " + m_text.substr(m_pos, 1));
+                return result;
+            }
+        private:
+            Curve sum()
+            {
+                auto left = product();
+                while(true)
+                {
+                    if(accept('+'))
+                        left = [left, right = product()](double x) { return left(x) + right(x); };
+                    else if(accept('-'))
+                        left = [left, right = product()](double x) { return left(x) - right(x); };
+                    else
+                        return left;
+                }
+            }
+
+            Curve product()
+            {
+                auto left = unary();
+                while(true)
+                {
+                    if(accept('*'))
+                        left = [left, right = unary()](double x) { return left(x) * right(x); };
+                    else if(accept('/'))
+                        left = [left, right = unary()](double x) { return left(x) / right(x); };
+                    else
+                        return left;
+                }
+            }
+
+            Curve unary()
+            {
+                if(accept('-'))
+                    return [operand = unary()](double x) { return -operand(x); };
+                accept('+');
+                return power();
+            }
+
+            Curve power()
+            {
+                auto base = primary();
+                if(accept('^'))
+                    // right associative, and binds tighter than a unary minus on its left
+                    return [base, exponent = unary()](double x) { return std::pow(base(x), exponent(x)); };
+                return base;
+            }
+
+            Curve primary()
+            {
+                skipSpace();
+                if(m_pos == m_text.size())
+                    fail("unexpected end");
+                if(accept('('))
+                {
+                    auto inner = sum();
+                    expect(')');
+                    return inner;
+                }
+                auto c = m_text[m_pos];
+                if(std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+                {
+                    char *end;
+                    auto value = std::strtod(m_text.c_str() + m_pos, &end);
+                    m_pos = end - m_text.c_str();
+                    return [value](double) { return value; };
+                }
+                if(!std::isalpha(static_cast<unsigned char>(c)))
+                    fail("unexpected " + m_text.substr(m_pos, 1));
+                auto start = m_pos;
+                while(m_pos < m_text.size() && std::isalnum(static_cast<unsigned char>(m_text[m_pos])))
+                    ++m_pos;
+                auto name = m_text.substr(start, m_pos - start);
+                if(name == "x")
+                    return [](double x) { return x; };
+                if(name == "pi")
+                    return [](double) { return M_PI; };
+                if(name == "e")
+                    return [](double) { return M_E; };
+                return call(name);
+            }
+
+            Curve call(std::string const& name)
+            {
+                const static std::map<std::string, double (*)(double)> unaries {
+                    {"abs", [](double v) { return std::fabs(v); }},
+                    {"sign", [](double v) { return v > 0. ? 1. : v < 0. ? -1. : 0.; }},
+                    {"sqrt", [](double v) { return std::sqrt(v); }},
+                    {"exp", [](double v) { return std::exp(v); }},
+                    {"log", [](double v) { return std::log(v); }},
+                    {"sin", [](double v) { return std::sin(v); }},
+                    {"cos", [](double v) { return std::cos(v); }},
+                    {"tanh", [](double v) { return std::tanh(v); }},
+                    {"atan", [](double v) { return std::atan(v); }},
+                };
+                const static std::map<std::string, double (*)(double, double)> binaries {
+                    {"pow", [](double a, double b) { return std::pow(a, b); }},
+                    {"min", [](double a, double b) { return std::min(a, b); }},
+                    {"max", [](double a, double b) { return std::max(a, b); }},
+                };
+                expect('(');
+                auto first = sum();
+                auto unaryIt = unaries.find(name);
+                if(unaryIt != unaries.end())
+                {
+                    expect(')');
+                    return [func = unaryIt->second, first](double x) { return func(first(x)); };
+                }
+                auto binaryIt = binaries.find(name);
+                if(binaryIt == binaries.end())
+                    fail("unknown function " + name);
+                expect(',');
+                auto second = sum();
+                expect(')');
+                return [func = binaryIt->second, first, second](double x) { return func(first(x), second(x)); };
+            }
+
+            void skipSpace()
+            {
+                while(m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+                    ++m_pos;
+            }
+
+            bool accept(char c)
+            {
+                skipSpace();
+                if(m_pos < m_text.size() && m_text[m_pos] == c)
+                {
+                    ++m_pos;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(char c)
+            {
+                if(!accept(c))
+                    fail(std::string("expected ") + c);
+            }
+
+            [[noreturn]] void fail(std::string const& message)
+            {
+                throw Waveshaper::Exception("Error in expression \"" + m_text + "\" at " + std::to_string(m_pos) + ": " + message);
+            }
+
+            std::string const& m_text;
+            std::size_t m_pos;
+        };
+    }
+
+    Waveshaper::Waveshaper(Curve const& curve, Settings settings)
+        : m_settings(settings)
+        , m_previous(0.f)
+        , m_previousAntiderivative(0.f)
+    {
+        tabulate(curve);
+    }
+
+    Waveshaper::Waveshaper(std::vector<double> const& coefficients, Settings settings)
+        : m_settings(settings)
+        , m_previous(0.f)
+        , m_previousAntiderivative(0.f)
+    {
+        if(settings.antialias)
+            tabulate(polynomial(coefficients));
+        else
+        {
+            m_scale = 0.f;
+            for(auto coefficient: coefficients)
+            {
+                if(!std::isfinite(static_cast<float>(coefficient)))
+                    throw Exception("Polynomial coefficient isn't finite");
+            }
+            m_polynomial.assign(coefficients.rbegin(), coefficients.rend());
+            if(m_polynomial.empty())
+                m_polynomial.push_back(0.f);
+        }
+    }
+
+    void Waveshaper::tabulate(Curve const& curve)
+    {
+        auto range = static_cast<double>(std::max(m_settings.range, 1e-3f));
+        m_settings.range = static_cast<float>(range);
+        auto size = std::max(m_settings.size, 4u);
+        auto step = 2. * range / (size - 1);
+        m_scale = static_cast<float>(1. / step);
+        m_table.resize(size + 2);
+        for(unsigned int i = 0; i < size; ++i)
+        {
+            auto x = -range + i * step;
+            auto y = static_cast<float>(curve(x));
+            if(!std::isfinite(y))
+                throw Exception("Curve isn't finite at x = " + std::to_string(x));
+            m_table[i + 1] = y;
+        }
+        // continue the end slopes into the padding
+        m_table[0] = 2.f * m_table[1] - m_table[2];
+        m_table[size + 1] = 2.f * m_table[size] - m_table[size - 1];
+        if(!m_settings.antialias)
+        {
+            if(m_settings.interpolation == Interpolation::Cubic)
+            {
+                // Catmull-Rom coefficients of every segment, highest power first
+                m_segments.resize(4 * (size - 1));
+                for(unsigned int i = 0; i + 1 < size; ++i)
+                {
+                    const float *p = m_table.data() + i;
+                    auto *segment = m_segments.data() + 4 * i;
+                    segment[0] = -0.5f * p[0] + 1.5f * p[1] - 1.5f * p[2] + 0.5f * p[3];
+                    segment[1] = p[0] - 2.5f * p[1] + 2.f * p[2] - 0.5f * p[3];
+                    segment[2] = -0.5f * p[0] + 0.5f * p[2];
+                    segment[3] = p[1];
+                }
+            }
+            return;
+        }
+        // Simpson's rule between the table points
+        m_antiderivative.resize(size + 2);
+        double integral = 0.;
+        m_antiderivative[1] = 0.f;
+        for(unsigned int i = 1; i < size; ++i)
+        {
+            auto x = -range + (i - 1) * step;
+            integral += step / 6. * (curve(x) + 4. * curve(x + step / 2.) + curve(x + step));
+            m_antiderivative[i + 1] = static_cast<float>(integral);
+        }
+        m_antiderivative[0] = 2.f * m_antiderivative[1] - m_antiderivative[2];
+        m_antiderivative[size + 1] = 2.f * m_antiderivative[size] - m_antiderivative[size - 1];
+        // only differences are used; small values near the origin keep them precise
+        auto origin = lookup(m_antiderivative, 0.f);
+        for(auto &value: m_antiderivative)
+            value -= origin;
+    }
+
+    float Waveshaper::lookup(std::vector<float> const& table, float x) const
+    {
+        auto position = (x + m_settings.range) * m_scale;
+        auto last = static_cast<float>(table.size() - 3);
+        position = std::min(std::max(position, 0.f), last);
+        auto index = std::min(static_cast<std::size_t>(position), table.size() - 4);
+        auto t = position - index;
+        const float *p = table.data() + index;
+        if(m_settings.interpolation == Interpolation::Linear)
+            return p[1] + t * (p[2] - p[1]);
+        // Catmull-Rom through p[0..3], between p[1] and p[2]
+        auto a = -0.5f * p[0] + 1.5f * p[1] - 1.5f * p[2] + 0.5f * p[3];
+        auto b = p[0] - 2.5f * p[1] + 2.f * p[2] - 0.5f * p[3];
+        auto c = -0.5f * p[0] + 0.5f * p[2];
+        return ((a * t + b) * t + c) * t + p[1];
+    }
+
+    float Waveshaper::curve(float x) const
+    {
+        return lookup(m_table, x);
+    }
+
+    float Waveshaper::antiderivative(float x) const
+    {
+        // the curve is held constant past the range, so its integral continues linearly
+        auto range = m_settings.range;
+        if(x > range)
+            return lookup(m_antiderivative, range) + (x - range) * curve(range);
+        if(x < -range)
+            return lookup(m_antiderivative, -range) + (x + range) * curve(-range);
+        return lookup(m_antiderivative, x);
+    }
+
+    void Waveshaper::operator()(const float *in, float *out, unsigned long samples)
+    {
+        auto range = m_settings.range;
+        if(!m_polynomial.empty())
+        {
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                auto x = std::min(std::max(in[i], -range), range);
+                auto y = m_polynomial[0];
+                for(std::size_t k = 1; k < m_polynomial.size(); ++k)
+                    y = y * x + m_polynomial[k];
+                out[i] = y;
+            }
+        }
+        else if(!m_settings.antialias)
+        {
+            // the same as curve(), unswitched and with 32 bit indices. The table reads are
+            // gathers, so GCC keeps these loops scalar even with -mavx2.
+            const float *table = m_table.data();
+            auto scale = m_scale;
+            auto last = static_cast<float>(m_table.size() - 3);
+            auto lastIndex = static_cast<int>(m_table.size() - 4);
+            if(m_settings.interpolation == Interpolation::Linear)
+            {
+                for(decltype(samples) i = 0; i < samples; ++i)
+                {
+                    auto position = std::min(std::max((in[i] + range) * scale, 0.f), last);
+                    auto index = std::min(static_cast<int>(position), lastIndex);
+                    auto t = position - index;
+                    auto y0 = table[index + 1];
+                    auto y1 = table[index + 2];
+                    out[i] = y0 + t * (y1 - y0);
+                }
+            }
+            else
+            {
+                const float *segments = m_segments.data();
+                for(decltype(samples) i = 0; i < samples; ++i)
+                {
+                    auto position = std::min(std::max((in[i] + range) * scale, 0.f), last);
+                    auto index = std::min(static_cast<int>(position), lastIndex);
+                    auto t = position - index;
+                    const float *segment = segments + 4 * index;
+                    out[i] = ((segment[0] * t + segment[1]) * t + segment[2]) * t + segment[3];
+                }
+            }
+        }
+        else
+        {
+            auto previous = m_previous;
+            auto previousAntiderivative = m_previousAntiderivative;
+            for(decltype(samples) i = 0; i < samples; ++i)
+            {
+                auto x = in[i];
+                auto integral = antiderivative(x);
+                auto delta = x - previous;
+                out[i] = std::fabs(delta) > s_antialiasEpsilon
+                    ? (integral - previousAntiderivative) / delta
+                    : curve(0.5f * (x + previous));
+                previous = x;
+                previousAntiderivative = integral;
+            }
+            m_previous = previous;
+            m_previousAntiderivative = previousAntiderivative;
+        }
+    }
+
+    Waveshaper::Curve Waveshaper::parseExpression(std::string const& expression)
+    {
+        return ExpressionParser(expression).parse();
+    }
+
+    Waveshaper::Curve Waveshaper::piecewise(std::vector<std::pair<double, double>> points)
+    {
+        if(points.empty())
+            return [](double) { return 0.; };
+        std::sort(points.begin(), points.end());
+        return [points = std::move(points)](double x) {
+            if(x <= points.front().first)
+                return points.front().second;
+            if(x >= points.back().first)
+                return points.back().second;
+            auto upper = std::upper_bound(points.begin(), points.end(), std::make_pair(x, -HUGE_VAL));
+            auto lower = upper - 1;
+            auto width = upper->first - lower->first;
+            if(width <= 0.)
+                return upper->second;
+            return lower->second + (x - lower->first) / width * (upper->second - lower->second);
+        };
+    }
+
+    Waveshaper::Curve Waveshaper::polynomial(std::vector<double> coefficients)
+    {
+        return [coefficients = std::move(coefficients)](double x) {
+            double y = 0.;
+            for(auto it = coefficients.rbegin(); it != coefficients.rend(); ++it)
+                y = y * x + *it;
+            return y;
+        };
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace deepness
+{
+    /*! A memoryless distortion whose transfer curve is given at runtime.
+     *
+     *  The curve is sampled once into a table over [-range, range] and read back with linear
+     *  or cubic interpolation; inputs outside the range are clamped, so curves should flatten
+     *  out there. With antialiasing the table holds the curve's antiderivative instead and
+     *  every output is the curve's mean between two successive inputs (first order ADAA),
+     *  which suppresses aliasing of the harmonics it creates at the cost of half a sample of
+     *  delay. A polynomial without antialiasing skips the table and runs Horner's scheme. */
+    class Waveshaper
+    {
+    public:
+        class Exception: public std::exception
+        {
+        public:
+            Exception(std::string message)
+                : m_message(std::move(message))
+            {}
+            const char* what() const noexcept override
+            {
+                return m_message.c_str();
+            }
+        private:
+            std::string m_message;
+        };
+        using Curve = std::function<double (double)>;
+        enum class Interpolation
+        {
+            Linear,
+            Cubic,
+        };
+        struct Settings
+        {
+            float range = 1.f;
+            unsigned int size = 4096;
+            Interpolation interpolation = Interpolation::Linear;
+            bool antialias = false;
+        };
+
+        /*! \throws Exception if \a curve isn't finite over the range */
+        Waveshaper(Curve const& curve, Settings settings);
+        /*! \param coefficients  constant term first
+         *  \throws Exception if a coefficient or, antialiased, the curve isn't finite */
+        Waveshaper(std::vector<double> const& coefficients, Settings settings);
+        void operator()(const float *in, float *out, unsigned long samples);
+
+        /*! Parses a formula in x, like "sign(x) * abs(x)^0.7". It knows + - * / ^, parentheses,
+         *  pi, e and the functions abs, sign, sqrt, exp, log, sin, cos, tanh, atan, pow, min
+         *  and max.
+         *  \throws Exception on a syntax error */
+        static Curve parseExpression(std::string const& expression);
+        /*! Straight lines between \a points, which are sorted by x here. */
+        static Curve piecewise(std::vector<std::pair<double, double>> points);
+        static Curve polynomial(std::vector<double> coefficients);
+    private:
+        void tabulate(Curve const& curve);
+        float lookup(std::vector<float> const& table, float x) const;
+        float curve(float x) const;
+        float antiderivative(float x) const;
+
+        Settings m_settings;
+        float m_scale;
+        std::vector<float> m_polynomial;
+        /*! padded by one point on either side for the cubic */
+        std::vector<float> m_table;
+        /*! cubic only: the four polynomial coefficients of every interval */
+        std::vector<float> m_segments;
+        std::vector<float> m_antiderivative;
+        float m_previous;
+        float m_previousAntiderivative;
+    };
+}
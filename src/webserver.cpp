@@ -5,36 +5,110 @@
 #include <boost/filesystem/fstream.hpp>
 #include <json11.hpp>
 #include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <zlib.h>
 
 namespace fs = boost::filesystem;
 
 namespace
 {
-    bool isInDirectory(fs::path const& path, fs::path const& root)
-    {
-        auto absolutepath = fs::absolute(path);
-        auto absoluteroot = fs::absolute(root);
-        return boost::starts_with(absolutepath.string(), absoluteroot.string());
-    }
-
     boost::optional<std::string> getMimeType(const std::string &extension)
     {
         // threadsafe because modern c++
         const static std::unordered_map<std::string, std::string> types {
-            {".html", "text/html"},
+            {".html", "text/html; charset=utf-8"},
             {".js", "application/javascript"},
+            {".css", "text/css"},
+            {".json", "application/json"},
+            {".map", "application/json"},
+            {".svg", "image/svg+xml"},
+            {".txt", "text/plain; charset=utf-8"},
+            {".png", "image/png"},
+            {".jpg", "image/jpeg"},
+            {".gif", "image/gif"},
+            {".ico", "image/x-icon"},
+            {".woff", "font/woff"},
+            {".woff2", "font/woff2"},
+            {".wasm", "application/wasm"},
         };
         auto it = types.find(extension);
         if(it != types.end())
             return it->second;
         return boost::none;
     }
+
+    bool isCompressible(std::string const& mime)
+    {
+        return boost::starts_with(mime, "text/")
+            || boost::starts_with(mime, "application/javascript")
+            || boost::starts_with(mime, "application/json")
+            || boost::starts_with(mime, "image/svg+xml");
+    }
+
+    std::string gzip(std::string const& data)
+    {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        // 16 + MAX_WBITS writes a gzip header instead of a zlib one
+        if(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+            return std::string();
+        std::string result(deflateBound(&stream, data.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+        stream.avail_out = static_cast<uInt>(result.size());
+        auto err = deflate(&stream, Z_FINISH);
+        result.resize(stream.total_out);
+        deflateEnd(&stream);
+        if(err != Z_STREAM_END)
+            return std::string();
+        return result;
+    }
+
+    std::string makeEtag(std::string const& data)
+    {
+        // FNV-1a of the content, so an unchanged file keeps its etag across reloads
+        std::uint64_t hash = 14695981039346656037ull;
+        for(auto c: data)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        std::ostringstream etag;
+        etag << '"' << std::hex << hash << std::dec << '-' << data.size() << '"';
+        return etag.str();
+    }
+
+    std::string readFile(fs::path const& path)
+    {
+        using namespace std;
+        fs::ifstream s(path, ios_base::in | ios_base::binary);
+        s.seekg(0, ios::end);
+        string data;
+        data.reserve(s.tellg());
+        s.seekg(0, ios::beg);
+        data.assign(istreambuf_iterator<char>(s),
+                    istreambuf_iterator<char>());
+        return data;
+    }
 }
 
 namespace deepness
 {
-    Webserver::Webserver(boost::filesystem::path document_root)
+    Webserver::Webserver(boost::filesystem::path document_root, bool watch, unsigned int ioThreads, unsigned int workerThreads)
         : m_root(std::move(document_root))
+        , m_assets(loadAssets(m_root))
+        , m_watching(watch)
+        , m_ioThreads(std::max(1u, ioThreads))
+        , m_workers(std::max(1u, workerThreads))
+        , m_started(false)
     {
         using std::placeholders::_1;
         // disable logging
@@ -45,15 +119,123 @@ namespace deepness
         m_server.set_open_handler(std::bind(&Webserver::handleOpen, this, _1));
         m_server.listen(8080);
         m_server.start_accept();
-        m_thread = std::thread([this] {
-                m_server.run();
-            });
+        if(watch)
+            m_watchThread = std::thread([this] {
+                    watchAssets();
+                });
     }
 
     Webserver::~Webserver()
     {
+        m_watching = false;
+        if(m_watchThread.joinable())
+            m_watchThread.join();
         m_server.stop();
-        m_thread.join();
+        for(auto &thread: m_threads)
+            thread.join();
+        m_workers.wait();
+    }
+
+    void Webserver::start()
+    {
+        if(m_started)
+            return;
+        m_started = true;
+        // the asio config enables multithreading, so every connection's handlers run on its
+        // own strand and one connection never runs on two threads at once
+        for(auto i = 0u; i < m_ioThreads; ++i)
+            m_threads.emplace_back([this] {
+                    m_server.run();
+                });
+    }
+
+    std::shared_ptr<const Webserver::AssetIndex> Webserver::loadAssets(fs::path const& root)
+    {
+        auto assets = std::make_shared<AssetIndex>();
+        if(!fs::is_directory(root))
+        {
+            std::cerr << "Document root " << root << " not found" << std::endl;
+            return assets;
+        }
+        auto absoluteroot = fs::absolute(root);
+        for(fs::recursive_directory_iterator it(absoluteroot), end; it != end; ++it)
+        {
+            auto const& path = it->path();
+            if(!fs::is_regular_file(path))
+                continue;
+            Asset asset;
+            asset.body = readFile(path);
+            asset.etag = makeEtag(asset.body);
+            auto mime = getMimeType(path.extension().string());
+            if(mime)
+            {
+                asset.mime = *mime;
+                if(isCompressible(asset.mime))
+                {
+                    asset.gzipBody = gzip(asset.body);
+                    if(asset.gzipBody.size() >= asset.body.size())
+                        asset.gzipBody.clear();
+                }
+            }
+            auto resource = "/" + path.lexically_relative(absoluteroot).generic_string();
+            if(path.filename() == "index.html")
+            {
+                // directories are served by their index.html, with or without the trailing slash
+                auto directory = resource.substr(0, resource.size() - std::strlen("index.html"));
+                (*assets)[directory] = asset;
+                if(directory.size() > 1)
+                    (*assets)[directory.substr(0, directory.size() - 1)] = asset;
+            }
+            (*assets)[resource] = std::move(asset);
+        }
+        return assets;
+    }
+
+    void Webserver::watchAssets()
+    {
+        while(m_watching)
+        {
+            auto fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if(fd < 0)
+            {
+                std::cerr << "Error initializing inotify: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            // watches aren't recursive, so every directory gets its own; they are set up
+            // again after each reload to pick up new directories
+            const auto mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+            inotify_add_watch(fd, m_root.c_str(), mask);
+            boost::system::error_code ec;
+            for(fs::recursive_directory_iterator it(m_root, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if(fs::is_directory(it->path()))
+                    inotify_add_watch(fd, it->path().c_str(), mask);
+            }
+            auto changed = false;
+            char events[4096];
+            while(m_watching)
+            {
+                pollfd pfd = {fd, POLLIN, 0};
+                auto ready = poll(&pfd, 1, changed ? 100 : 500);
+                if(ready > 0)
+                {
+                    while(read(fd, events, sizeof(events)) > 0)
+                    {}
+                    changed = true;
+                }
+                else if(ready == 0 && changed)
+                {
+                    // the burst of events from saving or copying files is over
+                    break;
+                }
+            }
+            close(fd);
+            if(!changed)
+                continue;
+            auto assets = loadAssets(m_root);
+            std::atomic_store(&m_assets, assets);
+            std::cerr << "Reloaded " << assets->size() << " assets from " << m_root << std::endl;
+        }
     }
 
     void Webserver::handleOpen(websocketpp::connection_hdl handle)
@@ -68,40 +250,38 @@ namespace deepness
 
     void Webserver::handleHttp(websocketpp::connection_hdl handle)
     {
-        using namespace std;
         using namespace websocketpp;
         auto connection = m_server.get_con_from_hdl(handle);
-        auto path = m_root / connection->get_resource();
-        if(!isInDirectory(path, m_root))
+        auto assets = std::atomic_load(&m_assets);
+        auto const& resource = connection->get_resource();
+        auto it = assets->find(resource.substr(0, resource.find('?')));
+        if(it == assets->end())
         {
             connection->set_status(http::status_code::not_found);
             return;
         }
-        if(!fs::is_regular_file(path))
+        auto const& asset = it->second;
+        connection->append_header("ETag", asset.etag);
+        connection->append_header("Cache-Control", "no-cache");
+        if(connection->get_request_header("If-None-Match") == asset.etag)
         {
-            auto indexpath = path / "index.html";
-            if(fs::is_directory(path) && fs::exists(indexpath))
-            {
-                path = std::move(indexpath);
-            }
-            else
+            connection->set_status(http::status_code::not_modified);
+            return;
+        }
+        connection->set_status(http::status_code::ok);
+        if(!asset.mime.empty())
+            connection->append_header("Content-Type", asset.mime);
+        if(!asset.gzipBody.empty())
+        {
+            connection->append_header("Vary", "Accept-Encoding");
+            if(connection->get_request_header("Accept-Encoding").find("gzip") != std::string::npos)
             {
-                connection->set_status(http::status_code::not_found);
+                connection->append_header("Content-Encoding", "gzip");
+                connection->set_body(asset.gzipBody);
                 return;
             }
         }
-        fs::ifstream s(path, ios_base::in | ios_base::binary);
-        s.seekg(0, ios::end);
-        string data;
-        data.reserve(s.tellg());
-        s.seekg(0, ios::beg);
-        data.assign(istreambuf_iterator<char>(s),
-                    istreambuf_iterator<char>());
-        connection->set_status(http::status_code::ok);
-        auto mime = getMimeType(path.extension().string());
-        if(mime)
-            connection->append_header("Content-Type", *mime);
-        connection->set_body(move(data));
+        connection->set_body(asset.body);
     }
 
     void Webserver::handleReceivedMessage(websocketpp::connection_hdl handle, Server::message_ptr msg)
@@ -120,38 +300,43 @@ namespace deepness
             std::cerr << "Bad message received: " << msg->get_payload() << std::endl;
             return;
         }
-        CommandHandler handler;
+        auto it = m_commands.find(cmd.string_value());
+        if(it == m_commands.end())
         {
-            std::lock_guard<std::mutex> lock(m_commandsMutex);
-            auto it = m_commands.find(cmd.string_value());
-            if(it == m_commands.end())
+            std::cerr << "Unexpected command received: " << cmd.string_value() << std::endl;
+            return;
+        }
+        auto const& command = it->second;
+        SendFunc send = [this, handle](std::string const& message) {
+            websocketpp::lib::error_code ec;
+            auto connection = m_server.get_con_from_hdl(handle, ec);
+            if(ec || !connection)
             {
-                std::cerr << "Unexpected command received: " << cmd.string_value() << std::endl;
-                return;
+                std::cerr << "Error sending message: " << ec.message() << std::endl;
+                return false;
+            }
+            ec = connection->send(message);
+            if(ec)
+            {
+                std::cerr << "Error sending message: " << ec.message() << std::endl;
+                return false;
             }
-            handler = it->second;
+            return true;
+        };
+        if(command.execution == Execution::Worker)
+        {
+            m_workers.submit([&command, args = doc["args"], send = std::move(send)](unsigned int) {
+                    command.handler(args, send);
+                });
+            return;
         }
-        handler(doc["args"], [this, handle](std::string const& message) {
-                websocketpp::lib::error_code ec;
-                auto connection = m_server.get_con_from_hdl(handle, ec);
-                if(ec || !connection)
-                {
-                    std::cerr << "Error sending message: " << ec.message() << std::endl;
-                    return false;
-                }
-                ec = connection->send(message);
-                if(ec)
-                {
-                    std::cerr << "Error sending message: " << ec.message() << std::endl;
-                    return false;
-                }
-                return true;
-            });
+        command.handler(doc["args"], send);
     }
 
-    void Webserver::handleMessage(std::string command, CommandHandler handler)
+    void Webserver::handleMessage(std::string command, CommandHandler handler, Execution execution)
     {
-        std::lock_guard<std::mutex> lock(m_commandsMutex);
-        m_commands[std::move(command)] = std::move(handler);
+        if(m_started)
+            throw std::logic_error("Command handlers must be registered before starting the webserver");
+        m_commands[std::move(command)] = Command{std::move(handler), execution};
     }
 }
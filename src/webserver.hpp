@@ -6,29 +6,72 @@
 #include <thread>
 #include <json11.hpp>
 #include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "threadpool.hpp"
 
 namespace deepness
 {
     class Webserver
     {
     public:
-        Webserver(boost::filesystem::path document_root);
+        /*! Everything below \a document_root is loaded into memory once.
+         *  \param watch  reload it when files change, using inotify
+         *  \param ioThreads  threads running socket I/O and inline handlers
+         *  \param workerThreads  threads running handlers registered with Execution::Worker */
+        Webserver(boost::filesystem::path document_root, bool watch = false, unsigned int ioThreads = 2, unsigned int workerThreads = 2);
         ~Webserver();
-        /*! \returns false if you should stop sending stuff to this socket. */
+        /*! \returns false if you should stop sending stuff to this socket.
+         *  Can be called from any thread, also after the handler returned. */
         using SendFunc = std::function<bool (std::string const&)>;
         using CommandHandler = std::function<void (json11::Json const& args, SendFunc)>;
+        enum class Execution
+        {
+            /*! on the I/O thread that received the message, for quick handlers */
+            Inline,
+            /*! on the worker pool, for anything that may block */
+            Worker,
+        };
         // TODO handle specific resources
-        void handleMessage(std::string command, CommandHandler handler);
+        /*! Only allowed before start(). */
+        void handleMessage(std::string command, CommandHandler handler, Execution execution = Execution::Inline);
+        /*! Freezes the handler table and starts serving. */
+        void start();
     private:
         using Server = websocketpp::server<websocketpp::config::asio>;
+        struct Asset
+        {
+            std::string body;
+            /*! empty if compressing doesn't pay off */
+            std::string gzipBody;
+            std::string mime;
+            std::string etag;
+        };
+        /*! maps request paths to files, immutable once built */
+        using AssetIndex = std::unordered_map<std::string, Asset>;
+        static std::shared_ptr<const AssetIndex> loadAssets(boost::filesystem::path const& root);
+        void watchAssets();
         void handleHttp(websocketpp::connection_hdl);
         void handleReceivedMessage(websocketpp::connection_hdl, Server::message_ptr msg);
         void handleOpen(websocketpp::connection_hdl);
 
+        struct Command
+        {
+            CommandHandler handler;
+            Execution execution;
+        };
+
         boost::filesystem::path m_root;
+        std::shared_ptr<const AssetIndex> m_assets;
+        std::atomic<bool> m_watching;
+        std::thread m_watchThread;
         Server m_server;
-        std::thread m_thread;
-        std::mutex m_commandsMutex;
-        std::unordered_map<std::string, CommandHandler> m_commands;
+        unsigned int m_ioThreads;
+        std::vector<std::thread> m_threads;
+        ThreadPool m_workers;
+        /*! written only before start(), so it is read without locking */
+        std::unordered_map<std::string, Command> m_commands;
+        bool m_started;
     };
 }